@@ -10,26 +10,60 @@
 
 #pragma once
 
+#include <errno.h>
 #include <string.h>
 
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtsc().
+#define LIMLOG_HAS_TSC
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef __linux
-#include <sys/syscall.h> // gettid().
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/futex.h>
+#include <sys/syscall.h> // gettid(), futex().
+#include <sys/uio.h>     // writev().
 #include <unistd.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define LIMLOG_HAS_IO_URING
+#endif
+#endif
 typedef pid_t thread_id_t;
 #elif __APPLE__
 #include <pthread.h>
+#include <sys/uio.h>
 typedef uint64_t thread_id_t;
 #else
 #include <sstream>
 typedef unsigned int thread_id_t; // MSVC
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
 #endif
 
 namespace limlog {
@@ -52,96 +86,525 @@ static constexpr char DigitsTable[200] = {
     '9', '0', '9', '1', '9', '2', '9', '3', '9', '4', '9', '5', '9', '6', '9',
     '7', '9', '8', '9', '9'};
 
-template <typename T,
-          typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
-static inline size_t formatUIntInternal(T v, char to[]) {
-  char *p = to;
+/// Number of significant bits of \a v , 0 has 1 bit.
+inline size_t bitWidth(uint64_t v) {
+  v |= 1;
+#if defined(__GNUC__)
+  return 64 - __builtin_clzll(v);
+#else
+  size_t bits = 0;
+  for (; v != 0; v >>= 1)
+    bits++;
+  return bits;
+#endif
+}
+
+/// Number of decimal digits of \a v .
+inline size_t countDigits(uint64_t v) {
+  static constexpr uint64_t kPowers[] = {1ULL,
+                                         10ULL,
+                                         100ULL,
+                                         1000ULL,
+                                         10000ULL,
+                                         100000ULL,
+                                         1000000ULL,
+                                         10000000ULL,
+                                         100000000ULL,
+                                         1000000000ULL,
+                                         10000000000ULL,
+                                         100000000000ULL,
+                                         1000000000000ULL,
+                                         10000000000000ULL,
+                                         100000000000000ULL,
+                                         1000000000000000ULL,
+                                         10000000000000000ULL,
+                                         100000000000000000ULL,
+                                         1000000000000000000ULL,
+                                         10000000000000000000ULL};
+
+  // bit width * log10(2), where log10(2) ~= 1233 / 4096, is the digits or one
+  // less, 0 has 1 digit.
+  size_t t = (bitWidth(v) * 1233) >> 12;
+  return t + ((v | 1) >= kPowers[t]);
+}
+
+/// Format \a n digits of \a v to \a to , two digits at a time from the end.
+template <typename T>
+inline void formatDigitsScalar(T v, char *to, size_t n) {
+  char *p = to + n;
 
   while (v >= 100) {
-    const unsigned idx = (v % 100) << 1;
+    const unsigned idx = static_cast<unsigned>(v % 100) << 1;
     v /= 100;
-    *p++ = DigitsTable[idx + 1];
-    *p++ = DigitsTable[idx];
+    p -= 2;
+    memcpy(p, &DigitsTable[idx], 2);
   }
 
   if (v < 10) {
-    *p++ = v + '0';
+    *--p = static_cast<char>(v + '0');
   } else {
-    const unsigned idx = v << 1;
-    *p++ = DigitsTable[idx + 1];
-    *p++ = DigitsTable[idx];
+    p -= 2;
+    memcpy(p, &DigitsTable[static_cast<unsigned>(v) << 1], 2);
   }
+}
 
-  return p - to;
+#ifdef __SSE2__
+/// Digits of \a v (< 10^8) in 8 16-bit lanes. \a v is split to 4 digits
+/// halves, which are divided by 10^3..10^0 with multiplication of reciprocal,
+/// and the digits are the quotients minus 10 times the former ones.
+/// ref: https://github.com/miloyip/itoa-benchmark/blob/master/src/sse2.cpp
+inline __m128i convert8Digits(uint32_t v) {
+  // abcd, efgh = abcdefgh divmod 10000.
+  const __m128i abcdefgh = _mm_cvtsi32_si128(static_cast<int>(v));
+  const __m128i abcd = _mm_srli_epi64(
+      _mm_mul_epu32(abcdefgh, _mm_set1_epi32(static_cast<int>(0xd1b71759))),
+      45);
+  const __m128i efgh = _mm_sub_epi32(
+      abcdefgh, _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+
+  // [abcd * 4] x 4, [efgh * 4] x 4.
+  const __m128i v1 = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+  const __m128i v2a = _mm_unpacklo_epi16(v1, v1);
+  const __m128i v2 = _mm_unpacklo_epi32(v2a, v2a);
+
+  // [a, ab, abc, abcd, e, ef, efg, efgh].
+  const __m128i v3 = _mm_mulhi_epu16(
+      v2, _mm_setr_epi16(8389, 5243, 13108, -32768, 8389, 5243, 13108,
+                         -32768));
+  const __m128i v4 = _mm_mulhi_epu16(
+      v3, _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, -32768, 1 << 7, 1 << 11,
+                         1 << 13, -32768));
+
+  // [a, b, c, d, e, f, g, h].
+  const __m128i v5 = _mm_mullo_epi16(v4, _mm_set1_epi16(10));
+  return _mm_sub_epi16(v4, _mm_slli_epi64(v5, 16));
 }
 
-template <typename T,
-          typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
-inline size_t formatSIntInternal(T v, char to[]) {
-  char *p = to;
+/// Format \a v (< 10^16) to 16 digits with leading zeros to \a to .
+inline void format16Digits(uint64_t v, char *to) {
+  const __m128i hi = convert8Digits(static_cast<uint32_t>(v / 100000000));
+  const __m128i lo = convert8Digits(static_cast<uint32_t>(v % 100000000));
+  const __m128i digits =
+      _mm_add_epi8(_mm_packus_epi16(hi, lo), _mm_set1_epi8('0'));
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(to), digits);
+}
+#endif
 
-  while (v <= static_cast<T>(-100)) {
-    const T idx = -(v % 100) * 2;
-    v /= 100;
-    *p++ = DigitsTable[idx + 1];
-    *p++ = DigitsTable[idx];
+/// Format \a n digits of \a v to \a to , which has exactly \a n bytes.
+/// More than 8 digits are converted 16 at once with SSE2.
+inline void formatDigits(uint64_t v, char *to, size_t n) {
+  if (n <= 8) {
+    formatDigitsScalar(static_cast<uint32_t>(v), to, n);
+    return;
   }
 
-  if (v > static_cast<T>(-10)) {
-    *p++ = -v + '0';
+#ifdef __SSE2__
+  if (n <= 16) {
+    char buf[16];
+    format16Digits(v, buf);
+    memcpy(to, buf + 16 - n, n);
   } else {
-    const T idx = -v * 2;
-    *p++ = DigitsTable[idx + 1];
-    *p++ = DigitsTable[idx];
+    const uint64_t kPow16 = 10000000000000000ULL;
+    formatDigitsScalar(static_cast<uint32_t>(v / kPow16), to, n - 16);
+    format16Digits(v % kPow16, to + n - 16);
   }
-
-  return p - to;
+#else
+  formatDigitsScalar(v, to, n);
+#endif
 }
 
+/// Format integer \a v to \a to , return the length.
+/// The length is counted first, so the digits are written in place without
+/// reversing.
 template <typename T,
           typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
 inline size_t formatInt(T v, char *to) {
-  char buf[sizeof(v) * 4];
+  typedef typename std::make_unsigned<T>::type U;
+  U u = static_cast<U>(v);
   size_t signLen = 0;
-  size_t intLen = 0;
 
   if (v < 0) {
     *to++ = '-';
     signLen = 1;
-    intLen = formatSIntInternal(v, buf);
-  } else {
-    intLen = formatUIntInternal(v, buf);
+    u = static_cast<U>(0 - u); // no overflow for the min value.
   }
 
-  char *p = buf + intLen;
-  for (size_t i = 0; i < intLen; ++i)
-    *to++ = *--p;
-
-  return signLen + intLen;
+  size_t n = countDigits(u);
+  formatDigits(u, to, n);
+  return signLen + n;
 }
 
+/// Format unsigned \a v to \a to with \a fmtLen digits, padded with leading
+/// zeros or truncated to the leading digits. Return \a fmtLen .
 template <typename T,
           typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
 inline size_t formatUIntWidth(T v, char *to, size_t fmtLen) {
-  char buf[sizeof(v) * 4];
-  size_t len = formatUIntInternal(v, buf);
-  char *p = buf + len;
+  uint64_t u = static_cast<uint64_t>(v);
+  size_t len = countDigits(u);
 
-  for (size_t i = len; i < fmtLen; i++)
-    *to++ = '0';
-
-  size_t minLen = std::min(len, fmtLen);
-  for (size_t i = 0; i < minLen; ++i)
-    *to++ = *--p;
+  if (len <= fmtLen) {
+    memset(to, '0', fmtLen - len);
+    formatDigits(u, to + fmtLen - len, len);
+  } else {
+    char buf[20];
+    formatDigits(u, buf, len);
+    memcpy(to, buf, fmtLen);
+  }
 
   return fmtLen;
 }
 
+/// Format \a v in lowercase hexadecimal to \a to , padded with leading zeros
+/// to \a width digits. Return the length.
+inline size_t formatHex(uint64_t v, char *to, size_t width = 0) {
+  static constexpr char kHexDigits[] = "0123456789abcdef";
+
+  size_t n = (bitWidth(v) + 3) / 4;
+  if (width > n) {
+    memset(to, '0', width - n);
+    to += width - n;
+  }
+
+  for (char *p = to + n; p != to; v >>= 4)
+    *--p = kHexDigits[v & 0xF];
+
+  return std::max(width, n);
+}
+
 inline size_t formatChar(char *to, char c) {
   *to = c;
   return sizeof(char);
 }
 
+// The cached powers of ten in the form of f * 2^e, from 10^-348 to 10^340 with
+// step 8, f is normalized. Used to scale binary exponent into the range of
+// Grisu2 digit generation.
+static constexpr uint64_t CachedPowersF[87] = {
+    0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76,
+    0xcf42894a5dce35ea, 0x9a6bb0aa55653b2d, 0xe61acf033d1a45df,
+    0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f, 0xbe5691ef416bd60c,
+    0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+    0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57,
+    0xc21094364dfb5637, 0x9096ea6f3848984f, 0xd77485cb25823ac7,
+    0xa086cfcd97bf97f4, 0xef340a98172aace5, 0xb23867fb2a35b28e,
+    0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+    0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126,
+    0xb5b5ada8aaff80b8, 0x87625f056c7c4a8b, 0xc9bcff6034c13053,
+    0x964e858c91ba2655, 0xdff9772470297ebd, 0xa6dfbd9fb8e5b88f,
+    0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+    0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06,
+    0xaa242499697392d3, 0xfd87b5f28300ca0e, 0xbce5086492111aeb,
+    0x8cbccc096f5088cc, 0xd1b71758e219652c, 0x9c40000000000000,
+    0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+    0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068,
+    0x9f4f2726179a2245, 0xed63a231d4c4fb27, 0xb0de65388cc8ada8,
+    0x83c7088e1aab65db, 0xc45d1df942711d9a, 0x924d692ca61be758,
+    0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+    0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d,
+    0x952ab45cfa97a0b3, 0xde469fbd99a05fe3, 0xa59bc234db398c25,
+    0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece, 0x88fcf317f22241e2,
+    0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+    0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410,
+    0x8bab8eefb6409c1a, 0xd01fef10a657842c, 0x9b10a4e5e9913129,
+    0xe7109bfba19c0c9d, 0xac2820d9623bf429, 0x80444b5e7aa7cf85,
+    0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+    0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b};
+
+static constexpr int16_t CachedPowersE[87] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+    -927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635,
+    -608, -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316,
+    -289, -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30, 56,
+    83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348, 375, 402, 428, 455,
+    481, 508, 534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800, 827, 853,
+    880, 907, 933, 960, 986, 1013, 1039, 1066};
+
+static constexpr uint32_t Pow10Table[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+/// Floating point number f * 2^e used by Grisu2 algorithm.
+/// ref: Printing Floating-Point Numbers Quickly and Accurately with Integers,
+/// Florian Loitsch, and the implementation of RapidJSON.
+struct DiyFp {
+  DiyFp(uint64_t f, int e) : f(f), e(e) {}
+
+  DiyFp operator-(const DiyFp &rhs) const { return DiyFp(f - rhs.f, e); }
+
+  /// Multiply and round to the upper 64 bits.
+  DiyFp operator*(const DiyFp &rhs) const {
+#ifdef __SIZEOF_INT128__
+    __uint128_t p = static_cast<__uint128_t>(f) * rhs.f;
+    uint64_t h = static_cast<uint64_t>(p >> 64);
+    uint64_t l = static_cast<uint64_t>(p);
+    if (l & (uint64_t(1) << 63))
+      h++;
+    return DiyFp(h, e + rhs.e + 64);
+#else
+    const uint64_t M32 = 0xFFFFFFFF;
+    const uint64_t a = f >> 32, b = f & M32;
+    const uint64_t c = rhs.f >> 32, d = rhs.f & M32;
+    const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += uint64_t(1) << 31; // round.
+    return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+#endif
+  }
+
+  /// Shift f until the highest bit is 1.
+  DiyFp normalize() const {
+    int s = 0;
+#if defined(__GNUC__) || defined(__clang__)
+    s = __builtin_clzll(f);
+#else
+    while (!(f & (uint64_t(1) << (63 - s))))
+      s++;
+#endif
+    return DiyFp(f << s, e - s);
+  }
+
+  uint64_t f;
+  int e;
+};
+
+template <typename T> struct FloatTraits;
+
+template <> struct FloatTraits<double> {
+  using Bits = uint64_t;
+  static constexpr int kSignificandSize = 52;
+  static constexpr int kExponentSize = 11;
+};
+
+template <> struct FloatTraits<float> {
+  using Bits = uint32_t;
+  static constexpr int kSignificandSize = 23;
+  static constexpr int kExponentSize = 8;
+};
+
+/// Get cached power c = 10^-K which make the exponent of c * 2^e in the range
+/// of [-60, -32].
+inline DiyFp getCachedPower(int e, int *K) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347; // 1 / lg(10)
+  int k = static_cast<int>(dk);
+  if (dk - k > 0.0)
+    k++;
+
+  unsigned index = static_cast<unsigned>((k >> 3) + 1);
+  *K = -(-348 + static_cast<int>(index << 3));
+  return DiyFp(CachedPowersF[index], CachedPowersE[index]);
+}
+
+/// Round the last digit to be closest to \a W in the range of \a delta .
+inline void grisuRound(char *buf, int len, uint64_t delta, uint64_t rest,
+                       uint64_t tenKappa, uint64_t wpw) {
+  while (rest < wpw && delta - rest >= tenKappa &&
+         (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw)) {
+    buf[len - 1]--;
+    rest += tenKappa;
+  }
+}
+
+/// Generate the shortest digits of \a W in the range of (Mp - delta, Mp).
+inline int digitGen(const DiyFp &W, const DiyFp &Mp, uint64_t delta, char *buf,
+                    int *K) {
+  const DiyFp one(uint64_t(1) << -Mp.e, Mp.e);
+  const DiyFp wpw = Mp - W;
+  uint32_t p1 = static_cast<uint32_t>(Mp.f >> -one.e);
+  uint64_t p2 = Mp.f & (one.f - 1);
+  int len = 0;
+
+  int kappa = 1;
+  while (kappa < 10 && p1 >= Pow10Table[kappa])
+    kappa++;
+
+  while (kappa > 0) {
+    uint32_t d = p1 / Pow10Table[kappa - 1];
+    p1 %= Pow10Table[kappa - 1];
+    if (d || len)
+      buf[len++] = static_cast<char>('0' + d);
+    kappa--;
+
+    uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+    if (rest <= delta) {
+      *K += kappa;
+      grisuRound(buf, len, delta, rest,
+                 static_cast<uint64_t>(Pow10Table[kappa]) << -one.e, wpw.f);
+      return len;
+    }
+  }
+
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    char d = static_cast<char>(p2 >> -one.e);
+    if (d || len)
+      buf[len++] = static_cast<char>('0' + d);
+    p2 &= one.f - 1;
+    kappa--;
+
+    if (p2 < delta) {
+      *K += kappa;
+      uint64_t unit = 1;
+      for (int i = 0; i < -kappa && i < 20; i++)
+        unit *= 10;
+      grisuRound(buf, len, delta, p2, one.f, wpw.f * unit);
+      return len;
+    }
+  }
+}
+
+/// Grisu2 algorithm, generate the shortest digits \a buf (at most 17) of
+/// positive \a v that \a v == buf * 10^K . Return length of digits.
+template <typename T> inline int grisu2(T v, char *buf, int *K) {
+  using Traits = FloatTraits<T>;
+  const int kSignificandSize = Traits::kSignificandSize;
+  const int kExponentBias =
+      (1 << (Traits::kExponentSize - 1)) - 1 + kSignificandSize;
+  const uint64_t kHiddenBit = uint64_t(1) << kSignificandSize;
+
+  typename Traits::Bits bits;
+  memcpy(&bits, &v, sizeof(v));
+  uint64_t significand = bits & (kHiddenBit - 1);
+  int biasedExp = static_cast<int>(bits >> kSignificandSize) &
+                  ((1 << Traits::kExponentSize) - 1);
+
+  DiyFp w = biasedExp != 0
+                ? DiyFp(significand + kHiddenBit, biasedExp - kExponentBias)
+                : DiyFp(significand, 1 - kExponentBias);
+
+  // boundaries of the values rounding to v, the lower one is closer when v
+  // is a power of 2.
+  DiyFp wp = DiyFp((w.f << 1) + 1, w.e - 1).normalize();
+  DiyFp wm = w.f == kHiddenBit ? DiyFp((w.f << 2) - 1, w.e - 2)
+                               : DiyFp((w.f << 1) - 1, w.e - 1);
+  wm.f <<= wm.e - wp.e;
+  wm.e = wp.e;
+
+  const DiyFp c = getCachedPower(wp.e, K);
+  const DiyFp W = w.normalize() * c;
+  DiyFp Wp = wp * c;
+  DiyFp Wm = wm * c;
+  Wm.f++;
+  Wp.f--;
+
+  return digitGen(W, Wp, Wp.f - Wm.f, buf, K);
+}
+
+/// Write exponent \a K as 'e+K' or 'e-K'.
+inline size_t formatExponent(int K, char *to) {
+  char *p = to;
+  *p++ = 'e';
+  *p++ = K < 0 ? '-' : '+';
+  p += formatInt(K < 0 ? -K : K, p);
+  return p - to;
+}
+
+/// Lay out \a len digits \a buf * 10^K to decimal notation if the exponent is
+/// in the range [-6, 21) (like printing a number in JavaScript), otherwise to
+/// scientific notation.
+inline size_t prettifyFloat(char *buf, int len, int K) {
+  const int kk = len + K; // 10^(kk-1) <= v < 10^kk
+
+  if (0 <= K && kk <= 21) {
+    // 1234e7 -> 12340000000
+    for (int i = len; i < kk; i++)
+      buf[i] = '0';
+    return kk;
+  } else if (0 < kk && kk <= 21) {
+    // 1234e-2 -> 12.34
+    memmove(&buf[kk + 1], &buf[kk], len - kk);
+    buf[kk] = '.';
+    return len + 1;
+  } else if (-6 < kk && kk <= 0) {
+    // 1234e-6 -> 0.001234
+    const int offset = 2 - kk;
+    memmove(&buf[offset], &buf[0], len);
+    buf[0] = '0';
+    buf[1] = '.';
+    for (int i = 2; i < offset; i++)
+      buf[i] = '0';
+    return len + offset;
+  } else if (len == 1) {
+    // 1e30
+    return 1 + formatExponent(kk - 1, &buf[1]);
+  } else {
+    // 1234e30 -> 1.234e+33
+    memmove(&buf[2], &buf[1], len - 1);
+    buf[1] = '.';
+    return len + 1 + formatExponent(kk - 1, &buf[len + 1]);
+  }
+}
+
+/// Max length of formatted float number.
+static constexpr size_t kMaxFloatLen = 32;
+
+/// Format special float number nan, inf and zero.
+template <typename T> inline size_t formatFloatSpecial(T v, char *to) {
+  if (v != v) {
+    memcpy(to, "nan", 3);
+    return 3;
+  }
+
+  char *p = to;
+  if (std::signbit(v))
+    *p++ = '-';
+  if (v == 0) {
+    *p++ = '0';
+  } else {
+    memcpy(p, "inf", 3);
+    p += 3;
+  }
+  return p - to;
+}
+
+/// Format float number \a v with the shortest digits which can be read back
+/// to the same number, e.g. 1.23, 0.001, 1e+30, nan and -inf. \a to has
+/// kMaxFloatLen bytes at least.
+template <typename T, typename std::enable_if<
+                          std::is_floating_point<T>::value, int>::type = 0>
+inline size_t formatFloat(T v, char *to) {
+  if (v == 0 || !std::isfinite(v))
+    return formatFloatSpecial(v, to);
+
+  char *p = to;
+  if (v < 0) {
+    *p++ = '-';
+    v = -v;
+  }
+
+  int K = 0;
+  int len = grisu2(v, p, &K);
+  return p - to + prettifyFloat(p, len, K);
+}
+
+/// Format float number \a v with fixed \a precision in the range [0, 9] like
+/// printf("%.*f"). Number not less than 1e15 is formatted by formatFloat().
+template <typename T, typename std::enable_if<
+                          std::is_floating_point<T>::value, int>::type = 0>
+inline size_t formatFloatFixed(T v, char *to, int precision) {
+  double a = std::fabs(static_cast<double>(v));
+  if (!std::isfinite(v) || a >= 1e15)
+    return formatFloat(v, to);
+
+  precision = std::min(std::max(precision, 0), 9);
+  uint64_t scale = Pow10Table[precision];
+  uint64_t integer = static_cast<uint64_t>(a);
+  uint64_t frac = static_cast<uint64_t>((a - integer) * scale + 0.5);
+  if (frac >= scale) {
+    integer++;
+    frac -= scale;
+  }
+
+  char *p = to;
+  if (std::signbit(v))
+    *p++ = '-';
+  p += formatInt(integer, p);
+  if (precision > 0) {
+    *p++ = '.';
+    p += formatUIntWidth(frac, p, precision);
+  }
+  return p - to;
+}
+
 enum TimeFieldLen : size_t {
   Year = 4,
   Month = 2,
@@ -153,6 +616,13 @@ enum TimeFieldLen : size_t {
 
 enum SecFracLen : size_t { Sec = 0, Milli = 3, Macro = 6, Nano = 9 };
 
+/// Sources of Time::now().
+enum ClockSource : uint8_t {
+  kSystemClock, // std::chrono::system_clock, may be a system call on VM.
+  kCoarseClock, // CLOCK_REALTIME_COARSE, in resolution of kernel tick.
+  kTscClock     // rdtsc interpolated between wall clock every second.
+};
+
 class Time {
 public:
   using TimePoint = std::chrono::time_point<std::chrono::system_clock,
@@ -165,8 +635,39 @@ public:
       : Time(TimePoint(std::chrono::seconds(second))) {}
   explicit Time(const TimePoint &tp) : tp_(tp) {}
 
-  /// Current time.
-  static Time now() { return Time(std::chrono::system_clock::now()); }
+  /// Current time from the clock source.
+  static Time now() {
+    switch (clockSource().load(std::memory_order_relaxed)) {
+    case kCoarseClock:
+      return Time(TimePoint(std::chrono::nanoseconds(coarseNow())));
+    case kTscClock:
+      return Time(TimePoint(std::chrono::nanoseconds(tscNow())));
+    default:
+      return Time(std::chrono::system_clock::now());
+    }
+  }
+
+  /// Set clock \a source of now(). The TSC clock calibrates the tick rate
+  /// for 10 ms here, and falls back to coarse clock without TSC, so does the
+  /// coarse clock to system clock if it is not supported.
+  static void setClockSource(ClockSource source) {
+#ifndef LIMLOG_HAS_TSC
+    if (source == kTscClock)
+      source = kCoarseClock;
+#endif
+#ifndef CLOCK_REALTIME_COARSE
+    if (source == kCoarseClock)
+      source = kSystemClock;
+#endif
+    if (source == kTscClock)
+      calibrateTsc();
+    clockSource().store(source, std::memory_order_relaxed);
+  }
+
+  /// Get clock source of now().
+  static ClockSource getClockSource() {
+    return clockSource().load(std::memory_order_relaxed);
+  }
 
   /// Year (4 digits, e.g. 1996).
   int year() const { return toTm().tm_year + 1900; }
@@ -236,6 +737,48 @@ public:
   ///   2021-10-10T05:46:58.123456789+08:00
   std::string formatNano() const { return formatInternal(SecFracLen::Nano); }
 
+  /// Max length of formatted date-time.
+  static constexpr size_t kMaxFormatLen = 40;
+
+  /// Format date-time with second fraction length \a fracLen to \a to , which
+  /// has kMaxFormatLen bytes at least. Return the formatted length.
+  /// Date-time and timezone offset are cached in thread and only reformatted
+  /// when the second changes, so just the fraction is formatted in the same
+  /// second without calling localtime_r().
+  size_t formatTo(char *to, size_t fracLen) const {
+    // "YYYY-MM-DDTHH:MM:SS" and "Z" or "+HH:MM" of cached second.
+    struct DateTimeCache {
+      int64_t second;
+      char datetime[19];
+      char off[6];
+      size_t offLen;
+    };
+    static thread_local DateTimeCache t_cache = {
+        std::numeric_limits<int64_t>::min(), {}, {}, 0};
+
+    int64_t second = std::chrono::system_clock::to_time_t(
+        std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+            tp_));
+    if (second != t_cache.second) {
+      struct tm t = toTm();
+      char *p = t_cache.datetime;
+      p += formatDate(p, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+      p += formatChar(p, 'T');
+      p += formatPartialTime(p, t.tm_hour, t.tm_min, t.tm_sec);
+      t_cache.offLen = formatTimeOff(t_cache.off, t.tm_gmtoff);
+      t_cache.second = second;
+    }
+
+    char *p = to;
+    memcpy(p, t_cache.datetime, sizeof(t_cache.datetime));
+    p += sizeof(t_cache.datetime);
+    p += formatSecFrac(p, nanosecond(), fracLen);
+    memcpy(p, t_cache.off, t_cache.offLen);
+    p += t_cache.offLen;
+
+    return p - to;
+  }
+
 private:
   struct tm toTm() const {
     struct tm t;
@@ -253,15 +796,8 @@ private:
   }
 
   std::string formatInternal(size_t fracLen) const {
-    char datetime[40];
-    char *p = datetime;
-    struct tm t = toTm();
-
-    p += formatDate(p, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-    p += formatChar(p, 'T');
-    p += formatTime(p, t.tm_hour, t.tm_min, t.tm_sec, fracLen);
-
-    return std::string(datetime, p - datetime);
+    char datetime[kMaxFormatLen];
+    return std::string(datetime, formatTo(datetime, fracLen));
   }
 
   size_t formatDate(char *to, int year, int mon, int mday) const {
@@ -274,27 +810,22 @@ private:
     return p - to;
   }
 
-  size_t formatTime(char *to, int hour, int min, int sec,
-                    size_t fracLen) const {
-    char *p = to;
-    p += formatPartialTime(p, hour, min, sec, fracLen);
-    p += formatTimeOff(p);
-    return p - to;
-  }
-
-  size_t formatPartialTime(char *to, int hour, int min, int sec,
-                           size_t fracLen) const {
+  size_t formatPartialTime(char *to, int hour, int min, int sec) const {
     char *p = to;
     p += formatUIntWidth(hour, p, TimeFieldLen::Hour);
     p += formatChar(p, ':');
     p += formatUIntWidth(min, p, TimeFieldLen::Minute);
     p += formatChar(p, ':');
     p += formatUIntWidth(sec, p, TimeFieldLen::Second);
-    p += formatSecFrac(p, nanosecond(), fracLen);
     return p - to;
   }
 
-  size_t formatSecFrac(char *to, int frac, size_t fracLen) const {
+  size_t formatSecFrac(char *to, int nano, size_t fracLen) const {
+    static constexpr int kFracDivisor[] = {1000000000, 100000000, 10000000,
+                                           1000000,    100000,    10000,
+                                           1000,       100,       10,
+                                           1};
+    int frac = nano / kFracDivisor[fracLen];
     if (fracLen == 0 || frac == 0)
       return 0;
 
@@ -304,22 +835,97 @@ private:
     return p - to;
   }
 
-  size_t formatTimeOff(char *to) const {
-    long int off = timezone().first;
+  size_t formatTimeOff(char *to, long int off) const {
     char *p = to;
 
     if (off == 0) {
       p += formatChar(p, 'Z');
     } else {
       p += formatChar(p, off < 0 ? '-' : '+');
+      off = off < 0 ? -off : off;
       p += formatUIntWidth(off / 3600, p, TimeFieldLen::Hour);
       p += formatChar(p, ':');
-      p += formatUIntWidth(off % 3600, p, TimeFieldLen::Minute);
+      p += formatUIntWidth(off % 3600 / 60, p, TimeFieldLen::Minute);
     }
 
     return p - to;
   }
 
+  static std::atomic<ClockSource> &clockSource() {
+    static std::atomic<ClockSource> s_source(kSystemClock);
+    return s_source;
+  }
+
+  static int64_t systemNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static int64_t coarseNow() {
+#ifdef CLOCK_REALTIME_COARSE
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * std::nano::den + ts.tv_nsec;
+#else
+    return systemNow();
+#endif
+  }
+
+  /// Nanoseconds per TSC tick, measured by calibrateTsc().
+  static std::atomic<double> &tscRate() {
+    static std::atomic<double> s_rate(0);
+    return s_rate;
+  }
+
+  static uint64_t rdtsc() {
+#ifdef LIMLOG_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+  }
+
+  static void calibrateTsc() {
+    int64_t ns = systemNow();
+    uint64_t tsc = rdtsc();
+    int64_t elapsed;
+    while ((elapsed = systemNow() - ns) < 10 * 1000 * 1000)
+      ;
+    tscRate().store(static_cast<double>(elapsed) / (rdtsc() - tsc));
+  }
+
+  /// Wall clock is read once a second for each thread as the anchor, the time
+  /// between is interpolated by the ticks elapsed, and the tick rate is
+  /// corrected by the two anchors.
+  static int64_t tscNow() {
+    struct Anchor {
+      uint64_t tsc;
+      int64_t ns;
+      double rate;
+    };
+    static thread_local Anchor t_anchor = {0, 0, 0};
+
+    // ticks may go backwards across cores, and the elapsed time is checked
+    // before converted to integer.
+    uint64_t tsc = rdtsc();
+    int64_t ticks = static_cast<int64_t>(tsc - t_anchor.tsc);
+    if (t_anchor.tsc != 0 && ticks >= 0) {
+      double elapsed = ticks * t_anchor.rate;
+      if (elapsed >= 0 && elapsed < std::nano::den)
+        return t_anchor.ns + static_cast<int64_t>(elapsed);
+    }
+
+    int64_t ns = systemNow();
+    if (t_anchor.tsc != 0 && ticks > 0)
+      t_anchor.rate = static_cast<double>(ns - t_anchor.ns) / ticks;
+    else
+      t_anchor.rate = tscRate().load();
+    t_anchor.tsc = tsc;
+    t_anchor.ns = ns;
+    return ns;
+  }
+
   TimePoint tp_;
 };
 
@@ -348,104 +954,392 @@ inline const char *stringifyLogLevel(LogLevel level) {
   return levelName[level];
 }
 
+/// Wait on \a addr until it is not \a expect , woken up or \a timeoutUs
+/// microseconds elapsed. Sleep the timeout if futex is not supported.
+inline void futexWait(std::atomic<uint32_t> *addr, uint32_t expect,
+                      uint32_t timeoutUs) {
+#ifdef __linux
+  struct timespec ts;
+  ts.tv_sec = timeoutUs / 1000000;
+  ts.tv_nsec = timeoutUs % 1000000 * 1000;
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAIT_PRIVATE,
+          expect, &ts, nullptr, 0);
+#else
+  if (addr->load() == expect)
+    std::this_thread::sleep_for(std::chrono::microseconds(timeoutUs));
+#endif
+}
+
+/// Wake up a thread waiting on \a addr .
+inline void futexWake(std::atomic<uint32_t> *addr) {
+#ifdef __linux
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAKE_PRIVATE, 1,
+          nullptr, nullptr, 0);
+#endif
+}
+
 /// Circle FIFO blocking produce/consume byte queue. Hold log info to wait for
 /// background thread consume. It exists in each thread.
+/// Positions written by producer and consumer are in separate cache lines, and
+/// each side caches the position of the other side, which is reloaded only
+/// when the cached one is not enough, so the cache line is rarely transferred.
 class BlockingBuffer {
 public:
-  BlockingBuffer() : producePos_(0), consumePos_(0), consumablePos_(0) {}
+  /// Default buffer size.
+  static const uint32_t kDefaultSize = 1024 * 1024 * 1; // 1 MB
+
+  /// Create buffer with \a size rounded up to power of 2, and the storage is
+  /// allocated from heap.
+  explicit BlockingBuffer(uint32_t size = kDefaultSize)
+      : size_(roundUpSize(size)), producePos_(0), consumablePos_(0),
+        consumePosCache_(0), consumePos_(0), consumablePosCache_(0),
+        next_(nullptr), waiting_(false), storage_(allocate(size_)) {}
+
+  ~BlockingBuffer() { deallocate(storage_, size_); }
+
+  BlockingBuffer(const BlockingBuffer &) = delete;
+  BlockingBuffer &operator=(const BlockingBuffer &) = delete;
 
   /// Buffer size.
-  uint32_t size() const { return kBlockingBufferSize; }
+  uint32_t size() const { return size_; }
+
+  /// Round up \a size to power of 2 within [kMinSize, kMaxSize].
+  static uint32_t roundUpSize(uint32_t size) {
+    uint32_t n = kMinSize;
+    while (n < size && n < kMaxSize)
+      n <<= 1;
+    return n;
+  }
 
   /// Already used bytes.
-  /// It may be called by different threads, so add memory barrier to
-  /// ensure the lasted *Pos_ is read.
+  /// It may be called by different threads, so load with acquire to ensure
+  /// the lasted *Pos_ is read.
   uint32_t used() const {
-    std::atomic_thread_fence(std::memory_order_acquire);
-    return producePos_ - consumePos_;
+    return producePos_.load(std::memory_order_acquire) -
+           consumePos_.load(std::memory_order_acquire);
   }
 
   /// Unused bytes.
-  uint32_t unused() const { return kBlockingBufferSize - used(); }
+  uint32_t unused() const { return size() - used(); }
+
+  /// Unused bytes from produce position until the end of buffer.
+  uint32_t unusedToEnd() const {
+    uint32_t pos = producePos_.load(std::memory_order_relaxed);
+    return std::min(unused(), size() - offsetOfPos(pos));
+  }
+
+  /// Whether \a n bytes are unused, called by the producer. Reload consume
+  /// position only if the cached one is not enough.
+  bool hasUnused(uint32_t n) {
+    uint32_t pos = producePos_.load(std::memory_order_relaxed);
+    if (size() - (pos - consumePosCache_) >= n)
+      return true;
+    consumePosCache_ = consumePos_.load(std::memory_order_acquire);
+    return size() - (pos - consumePosCache_) >= n;
+  }
 
   /// Reset buffer's position.
   void reset() {
-    producePos_ = 0;
-    consumePos_ = 0;
-    consumablePos_ = 0;
+    producePos_.store(0, std::memory_order_relaxed);
+    consumePos_.store(0, std::memory_order_relaxed);
+    consumablePos_.store(0, std::memory_order_relaxed);
+    consumePosCache_ = 0;
+    consumablePosCache_ = 0;
+  }
+
+  /// Move the unconsumed data to the beginning of buffer. Only used when
+  /// there is no consumer thread.
+  void rewind() {
+    uint32_t n = used();
+    uint32_t c = consumable();
+    uint32_t off = offsetOfPos(consumePos_.load(std::memory_order_relaxed));
+
+    if (off + n <= size())
+      memmove(storage_, storage_ + off, n);
+    else
+      std::rotate(storage_, storage_ + off, storage_ + size());
+
+    reset();
+    consumablePos_.store(c, std::memory_order_relaxed);
+    producePos_.store(n, std::memory_order_relaxed);
   }
 
   /// The position at the end of the last complete log.
   uint32_t consumable() const {
-    std::atomic_thread_fence(std::memory_order_acquire);
-    return consumablePos_ - consumePos_;
+    return consumablePos_.load(std::memory_order_acquire) -
+           consumePos_.load(std::memory_order_acquire);
+  }
+
+  /// Bytes of the incomplete log, called by the producer.
+  uint32_t incomplete() const {
+    return producePos_.load(std::memory_order_relaxed) -
+           consumablePos_.load(std::memory_order_relaxed);
   }
 
   /// Increase consumable position with a complete log length \a n .
   void incConsumablePos(uint32_t n) {
-    consumablePos_ += n;
-    std::atomic_thread_fence(std::memory_order_release);
+    // publish the log data before the consumable position.
+    uint32_t pos = consumablePos_.load(std::memory_order_relaxed);
+    consumablePos_.store(pos + n, std::memory_order_release);
   }
 
   /// Pointer to comsume position.
-  char *data() { return &storage_[offsetOfPos(consumePos_)]; }
+  char *data() {
+    return &storage_[offsetOfPos(consumePos_.load(std::memory_order_relaxed))];
+  }
+
+  /// Consumable bytes from consume position until the end of buffer, the rest
+  /// is at the beginning of buffer if it wraps around.
+  uint32_t consumableToEnd() const {
+    uint32_t pos = consumePos_.load(std::memory_order_relaxed);
+    return std::min(consumable(), size() - offsetOfPos(pos));
+  }
 
   /// Consume n bytes data and only move the consume position.
-  void consume(uint32_t n) { consumePos_ += n; }
+  void consume(uint32_t n) {
+    consumePos_.fetch_add(n, std::memory_order_release);
+  }
 
-  /// Consume \a n bytes data to \a to .
+  /// Consume \a n bytes data to \a to . Return 0 if the producer discarded
+  /// the data while copying, see discard().
   uint32_t consume(char *to, uint32_t n) {
+    uint32_t pos = consumePos();
+
     // available bytes to consume.
-    uint32_t avail = std::min(consumable(), n);
+    uint32_t avail = std::min(consumableFrom(pos), n);
+    if (avail == 0)
+      return 0;
 
-    // offset of consumePos to buffer end.
-    uint32_t off2End = std::min(avail, size() - offsetOfPos(consumePos_));
+    copyOut(pos, to, avail);
+    return release(pos, avail) ? avail : 0;
+  }
 
-    // first put the data starting from consumePos until the end of buffer.
-    memcpy(to, storage_ + offsetOfPos(consumePos_), off2End);
+  /// Consume position, called by the consumer.
+  uint32_t consumePos() const {
+    return consumePos_.load(std::memory_order_relaxed);
+  }
 
-    // then put the rest at beginning of the buffer.
-    memcpy(to + off2End, storage_, avail - off2End);
+  /// Copy \a n bytes at position \a pos to \a to without consuming, called
+  /// by the consumer. Return false if they are not consumable, or discarded
+  /// by the producer during the copy, then the copy may be torn.
+  bool read(uint32_t pos, char *to, uint32_t n) {
+    uint32_t c = consumePos();
+    if (pos - c + n > consumableFrom(c))
+      return false;
+    copyOut(pos, to, n);
+
+    // the copy is done before checking the consume position again.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return consumePos_.load(std::memory_order_relaxed) == c;
+  }
+
+  /// Release \a n bytes at position \a pos read by the consumer to producer.
+  /// Return false if the producer discarded them meanwhile, then the copy may
+  /// be overwritten.
+  bool release(uint32_t pos, uint32_t n) {
+    // finish reading before the space is released to producer.
+    if (!consumePos_.compare_exchange_strong(pos, pos + n))
+      return false;
+
+    if (waiting_.load())
+      futexWake(&consumePos_);
+    return true;
+  }
+
+  /// Discard the complete logs not consumed yet to make room, called by the
+  /// producer. Return the discarded bytes.
+  uint32_t discard() {
+    uint32_t pos = consumePos_.load(std::memory_order_acquire);
+    uint32_t end = consumablePos_.load(std::memory_order_relaxed);
+    if (pos == end || !consumePos_.compare_exchange_strong(pos, end))
+      return 0;
+    consumePosCache_ = end;
+    return end - pos;
+  }
+
+  /// Discard the incomplete log after the consumable position, called by the
+  /// producer.
+  void truncate() {
+    producePos_.store(consumablePos_.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+  }
+
+  /// Overwrite the incomplete log at \a offset with \a n bytes \a data ,
+  /// called by the producer.
+  void patch(uint32_t offset, const char *data, uint32_t n) {
+    uint32_t off = offsetOfPos(consumablePos_.load(std::memory_order_relaxed) +
+                               offset);
+    uint32_t off2End = std::min(n, size() - off);
+    memcpy(storage_ + off, data, off2End);
+    memcpy(storage_, data + off2End, n - off2End);
+  }
 
-    consumePos_ += avail;
-    std::atomic_thread_fence(std::memory_order_release);
+  /// Move the incomplete log to buffer \a to , called by the producer.
+  void moveIncomplete(BlockingBuffer *to) {
+    uint32_t n = incomplete();
+    uint32_t off = offsetOfPos(consumablePos_.load(std::memory_order_relaxed));
+    uint32_t off2End = std::min(n, size() - off);
+    to->produce(storage_ + off, off2End);
+    to->produce(storage_, n - off2End);
+    truncate();
+  }
+
+  /// Seal the buffer with the \a next buffer which the producer moves to, the
+  /// consumer moves to it after this one is consumed. Called by the producer
+  /// after the last log is complete.
+  void seal(BlockingBuffer *next) {
+    next_.store(next, std::memory_order_release);
+  }
 
-    return avail;
+  /// The next buffer if sealed, otherwise nullptr.
+  BlockingBuffer *next() const { return next_.load(std::memory_order_acquire); }
+
+  /// Wait until \a n bytes are unused. Spin at first, then yield the CPU, and
+  /// finally sleep until the consumer wakes it up.
+  void waitUnused(uint32_t n) {
+    for (uint32_t i = 0; !hasUnused(n); i++) {
+      if (i < kSpinCount)
+        continue;
+
+      if (i < kSpinCount + kYieldCount) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      // announce waiting before reading consume position, so the consumer
+      // either sees waiting_ or the position read here is stale and futex
+      // returns immediately.
+      waiting_.store(true);
+      uint32_t pos = consumePos_.load();
+      if (!hasUnused(n))
+        futexWait(&consumePos_, pos, kWaitTimeoutUs);
+      waiting_.store(false);
+    }
   }
 
   /// Copy \a n bytes log info from \a from to buffer. It will be blocking
   /// when buffer space is insufficient.
   void produce(const char *from, uint32_t n) {
     n = std::min(size(), n);
-    while (unused() < n)
-      /* blocking */;
+    waitUnused(n);
+
+    uint32_t pos = producePos_.load(std::memory_order_relaxed);
 
     // offset of producePos to buffer end.
-    uint32_t off2End = std::min(n, size() - offsetOfPos(producePos_));
+    uint32_t off2End = std::min(n, size() - offsetOfPos(pos));
 
     // first put the data starting from producePos until the end of buffer.
-    memcpy(storage_ + offsetOfPos(producePos_), from, off2End);
+    memcpy(storage_ + offsetOfPos(pos), from, off2End);
 
     // then put the rest at beginning of the buffer.
     memcpy(storage_, from + off2End, n - off2End);
 
-    producePos_ += n;
-    std::atomic_thread_fence(std::memory_order_release);
+    producePos_.store(pos + n, std::memory_order_release);
+  }
+
+  /// Reserve \a n bytes contiguous space at produce position to format log
+  /// in place, then commit() the written length. Return nullptr if the unused
+  /// space is insufficient or the space wraps around the buffer end, use
+  /// produce() instead in that case.
+  char *reserve(uint32_t n) {
+    uint32_t off = offsetOfPos(producePos_.load(std::memory_order_relaxed));
+    if (size() - off < n || !hasUnused(n))
+      return nullptr;
+    return storage_ + off;
+  }
+
+  /// Commit \a n bytes written to the reserved space.
+  void commit(uint32_t n) {
+    uint32_t pos = producePos_.load(std::memory_order_relaxed);
+    producePos_.store(pos + n, std::memory_order_release);
   }
 
 private:
   /// Get position offset calculated from buffer start.
-  uint32_t offsetOfPos(uint32_t pos) const { return pos & (size() - 1); }
+  uint32_t offsetOfPos(uint32_t pos) const { return pos & (size_ - 1); }
+
+  /// Consumable bytes from position \a pos , called by the consumer. Reload
+  /// consumable position only if the cached one is consumed, the producer
+  /// may move consume position beyond it by discard().
+  uint32_t consumableFrom(uint32_t pos) {
+    if (static_cast<int32_t>(consumablePosCache_ - pos) <= 0) {
+      consumablePosCache_ = consumablePos_.load(std::memory_order_acquire);
+      if (static_cast<int32_t>(consumablePosCache_ - pos) <= 0)
+        return 0;
+    }
+    return consumablePosCache_ - pos;
+  }
+
+  /// Copy \a n bytes at position \a pos to \a to .
+  void copyOut(uint32_t pos, char *to, uint32_t n) const {
+    // offset of pos to buffer end.
+    uint32_t off2End = std::min(n, size() - offsetOfPos(pos));
+
+    // first put the data starting from pos until the end of buffer.
+    memcpy(to, storage_ + offsetOfPos(pos), off2End);
+
+    // then put the rest at beginning of the buffer.
+    memcpy(to + off2End, storage_, n - off2End);
+  }
 
-  static const uint32_t kBlockingBufferSize = 1024 * 1024 * 1; // 1 MB
-  uint32_t producePos_;
-  uint32_t consumePos_;
-  uint32_t consumablePos_; // increase every time with a complete log length.
-  char storage_[kBlockingBufferSize]; // buffer size power of 2.
+  /// Allocate storage with \a size , pages are committed on first touch and
+  /// backed by huge pages if possible.
+  static char *allocate(uint32_t size) {
+#ifdef __linux
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (size >= kHugePageSize)
+      madvise(p, size, MADV_HUGEPAGE);
+#endif
+    return static_cast<char *>(p);
+#else
+    return new char[size];
+#endif
+  }
+
+  static void deallocate(char *p, uint32_t size) {
+#ifdef __linux
+    munmap(p, size);
+#else
+    delete[] p;
+#endif
+  }
+
+  static const uint32_t kMinSize = 1024 * 4;               // 4 KB
+  static const uint32_t kMaxSize = 1024 * 1024 * 1024;     // 1 GB
+  static const uint32_t kHugePageSize = 1024 * 1024 * 2;   // 2 MB
+  static const uint32_t kSpinCount = 1024;
+  static const uint32_t kYieldCount = 64;
+  static const uint32_t kWaitTimeoutUs = 1000;
+  static const size_t kCacheLineSize = 64;
+
+  const uint32_t size_; // power of 2.
+
+  // written by producer.
+  char pad0_[kCacheLineSize];
+  std::atomic<uint32_t> producePos_;
+  std::atomic<uint32_t> consumablePos_; // increase with a complete log length.
+  uint32_t consumePosCache_;
+
+  // written by consumer, and by producer in discard().
+  char pad1_[kCacheLineSize];
+  std::atomic<uint32_t> consumePos_;
+  uint32_t consumablePosCache_;
+
+  char pad2_[kCacheLineSize];
+  std::atomic<BlockingBuffer *> next_;
+  std::atomic<bool> waiting_; // producer is sleeping on consumePos_.
+  char *storage_;
 };
 
 using OutputFunc = ssize_t (*)(const char *, size_t);
 
+/// Output of several segments in a call, like writev().
+using OutputVecFunc = ssize_t (*)(const struct iovec *, int);
+
 struct StdoutWriter {
   static ssize_t write(const char *data, size_t n) {
     return fwrite(data, sizeof(char), n, stdout);
@@ -456,106 +1350,3072 @@ struct NullWriter {
   static ssize_t write(const char *data, size_t n) { return 0; }
 };
 
-class SyncLogger {
+#ifdef __linux
+/// Write logs to a file descriptor. writev() is an OutputVecFunc, it writes
+/// all segments of an output in a system call, e.g.
+///   limlog::FdWriter::instance().open("app.log");
+///   limlog::singleton()->setOutput(limlog::FdWriter::writev);
+class FdWriter {
 public:
-  SyncLogger() : output_(StdoutWriter::write) {}
+  FdWriter() : fd_(-1), owned_(false) {}
+  ~FdWriter() { close(); }
 
-  void setOutput(OutputFunc w) { output_ = w; }
+  FdWriter(const FdWriter &) = delete;
+  FdWriter &operator=(const FdWriter &) = delete;
 
-  void produce(const char *data, size_t n) { buffer_.produce(data, n); }
+  /// Writer used by write() and writev().
+  static FdWriter &instance() {
+    static FdWriter s_writer;
+    return s_writer;
+  }
 
-  void flush(size_t n) {
-    buffer_.incConsumablePos(n);
-    output_(buffer_.data(), buffer_.consumable());
-    buffer_.reset();
+  /// OutputFunc writing to instance(), open it before logging.
+  static ssize_t write(const char *data, size_t n) {
+    struct iovec iov = {const_cast<char *>(data), n};
+    return instance().append(&iov, 1);
   }
 
-private:
-  OutputFunc output_;
-  BlockingBuffer buffer_;
-};
+  /// OutputVecFunc writing to instance(), open it before logging.
+  static ssize_t writev(const struct iovec *iov, int cnt) {
+    return instance().append(iov, cnt);
+  }
 
-class AsyncLogger {
-public:
-  AsyncLogger() : output_(StdoutWriter::write) {}
+  /// Open file \a path to append.
+  bool open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                    0644);
+    if (fd < 0)
+      return false;
+    fd_ = fd;
+    owned_ = true;
+    return true;
+  }
 
-  void setOutput(OutputFunc w) { output_ = w; }
+  /// Write to \a fd , e.g. a pipe or socket, it is not closed by FdWriter.
+  void setFd(int fd) {
+    close();
+    fd_ = fd;
+  }
 
-  /// TODO:
-  void produce(const char *data, size_t n) {}
+  /// Close the file opened by open().
+  void close() {
+    if (owned_ && fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+    owned_ = false;
+  }
 
-  /// TODO:
-  void flush(size_t n) {}
+  /// Write \a cnt segments \a iov , the rest is written again after a partial
+  /// write. Return the written bytes, or -1 if nothing is written.
+  ssize_t append(const struct iovec *iov, int cnt) {
+    struct iovec vec[kMaxSegments];
+    ssize_t total = 0;
+    size_t off = 0; // written bytes of iov[0].
+    while (cnt > 0) {
+      int n = std::min(cnt, kMaxSegments);
+      memcpy(vec, iov, n * sizeof(*iov));
+      vec[0].iov_base = static_cast<char *>(vec[0].iov_base) + off;
+      vec[0].iov_len -= off;
+
+      ssize_t r = ::writev(fd_, vec, n);
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r <= 0)
+        return total != 0 ? total : r;
+      total += r;
+
+      // skip the written segments.
+      size_t left = off + r;
+      while (cnt > 0 && left >= iov->iov_len) {
+        left -= iov->iov_len;
+        iov++;
+        cnt--;
+      }
+      off = left;
+    }
+    return total;
+  }
 
 private:
-  OutputFunc output_;
+  /// Segments written in a system call, far below IOV_MAX.
+  static const int kMaxSegments = 64;
+
+  int fd_;
+  bool owned_; // fd_ is opened by open().
 };
 
-template <typename Logger> class LimLog {
+/// Write logs into a memory mapped file which is preallocated to the rotate
+/// size, so output is a memcpy without system call. The file is rotated when
+/// it is full or the rotate interval elapsed: the written part is kept, then
+/// it is renamed to 'path.YYYYmmdd-HHMMSS' and a new file is created at path.
+/// e.g.
+///   limlog::MmapFileWriter::instance().open("app.log", 64 << 20);
+///   limlog::singleton()->setOutput(limlog::MmapFileWriter::write);
+class MmapFileWriter {
 public:
-  LimLog() : level_(LogLevel::kInfo), output_(StdoutWriter::write) {}
-  ~LimLog() {
-    for (auto l : loggers_)
-      delete (l);
+  MmapFileWriter()
+      : fd_(-1), map_(nullptr), offset_(0), rotateSize_(0),
+        rotateInterval_(0), openTime_(0), retryTime_(0) {}
+  ~MmapFileWriter() { close(); }
+
+  MmapFileWriter(const MmapFileWriter &) = delete;
+  MmapFileWriter &operator=(const MmapFileWriter &) = delete;
+
+  /// Writer used by write().
+  static MmapFileWriter &instance() {
+    static MmapFileWriter s_writer;
+    return s_writer;
   }
-  LimLog(const LimLog &) = delete;
-  LimLog &operator=(const LimLog &) = delete;
 
-  /// Produce \a data which length \a n to BlockingBuffer in each thread.
-  void produce(const char *data, size_t n) { logger()->produce(data, n); }
+  /// OutputFunc writing to instance(), open it before logging.
+  static ssize_t write(const char *data, size_t n) {
+    return instance().append(data, n);
+  }
 
-  /// Flush a logline with length \a n .
-  void flush(size_t n) { logger()->flush(n); }
+  /// Open log file \a path and rotate it every \a rotateSize bytes, and
+  /// every \a rotateInterval if it is not zero. An existing non-empty file
+  /// at \a path is rotated first. Errors are reported to stderr, and the
+  /// file is opened again by append() after a failure.
+  bool open(const std::string &path, size_t rotateSize,
+            std::chrono::seconds rotateInterval = std::chrono::seconds(0)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closeFile();
+
+    path_ = path;
+    rotateSize_ = rotateSize;
+    rotateInterval_ = rotateInterval.count();
+    retryTime_ = 0;
+    return archiveFile() && openFile();
+  }
 
-  /// Set log level \a level.
-  void setLogLevel(LogLevel level) { level_ = level; }
+  /// Append \a n bytes \a data to file, rotate file if necessary.
+  /// Return -1 if file is not opened, it is retried every kRetryInterval
+  /// seconds after a failed open or rotation.
+  ssize_t append(const char *data, size_t n) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!map_) {
+      time_t now = time(nullptr);
+      if (path_.empty() || now < retryTime_)
+        return -1;
+      retryTime_ = now + kRetryInterval;
+      if (!archiveFile() || !openFile())
+        return -1;
+    }
 
-  /// Get log level.
-  LogLevel getLogLevel() const { return level_; }
+    if (rotateInterval_ != 0 && time(nullptr) - openTime_ >= rotateInterval_) {
+      // no need to archive an empty file.
+      if (offset_ == 0)
+        openTime_ = time(nullptr);
+      else
+        rotate();
+    }
 
-  /// Set logger output \a w .
+    size_t written = 0;
+    while (map_ && written < n) {
+      if (offset_ == rotateSize_ && !rotate())
+        break;
+
+      size_t len = std::min(n - written, rotateSize_ - offset_);
+      memcpy(map_ + offset_, data + written, len);
+      offset_ += len;
+      written += len;
+    }
+
+    return written;
+  }
+
+  /// Truncate file to the written size and close it.
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closeFile();
+    path_.clear();
+  }
+
+private:
+  static const time_t kRetryInterval = 1;
+
+  /// Report error \a err of \a what on the file to stderr.
+  void report(const char *what, int err) const {
+    std::string msg = "limlog: " + std::string(what) + " '" + path_ +
+                      "': " + strerror(err) + "\n";
+    if (::write(STDERR_FILENO, msg.data(), msg.size()) < 0) {
+      // nowhere else to report.
+    }
+  }
+
+  bool openFile() {
+    offset_ = 0;
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      report("open", errno);
+      return false;
+    }
+
+    // preallocate disk blocks so page faults on the mapping never hit ENOSPC.
+    int err = posix_fallocate(fd_, 0, rotateSize_);
+    if (err != 0) {
+      report("fallocate", err);
+      closeFile();
+      return false;
+    }
+
+    void *m =
+        mmap(nullptr, rotateSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (m == MAP_FAILED) {
+      report("mmap", errno);
+      closeFile();
+      return false;
+    }
+
+    map_ = static_cast<char *>(m);
+    offset_ = 0;
+    openTime_ = time(nullptr);
+    return true;
+  }
+
+  void closeFile() {
+    if (map_) {
+      munmap(map_, rotateSize_);
+      map_ = nullptr;
+    }
+
+    if (fd_ >= 0) {
+      // drop the preallocated but unused tail, it's kept as zero on failure.
+      if (ftruncate(fd_, offset_) != 0)
+        report("truncate", errno);
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  /// Rename the non-empty file at path to archive path. The file is kept if
+  /// it fails, rather than truncated by openFile().
+  bool archiveFile() {
+    struct stat st;
+    if (::stat(path_.c_str(), &st) != 0 || st.st_size == 0)
+      return true;
+    if (::rename(path_.c_str(), archivePath().c_str()) == 0)
+      return true;
+    report("rename", errno);
+    return false;
+  }
+
+  /// Close the current file, rename it to archive path and open a new one.
+  bool rotate() {
+    closeFile();
+    if (archiveFile() && openFile())
+      return true;
+    retryTime_ = time(nullptr) + kRetryInterval;
+    return false;
+  }
+
+  /// 'path.YYYYmmdd-HHMMSS' of now, a sequence suffix is appended if the
+  /// file exists already.
+  std::string archivePath() const {
+    time_t now = time(nullptr);
+    struct tm t;
+    localtime_r(&now, &t);
+
+    char suffix[32];
+    char *p = suffix;
+    p += formatChar(p, '.');
+    p += formatUIntWidth(t.tm_year + 1900, p, TimeFieldLen::Year);
+    p += formatUIntWidth(t.tm_mon + 1, p, TimeFieldLen::Month);
+    p += formatUIntWidth(t.tm_mday, p, TimeFieldLen::Day);
+    p += formatChar(p, '-');
+    p += formatUIntWidth(t.tm_hour, p, TimeFieldLen::Hour);
+    p += formatUIntWidth(t.tm_min, p, TimeFieldLen::Minute);
+    p += formatUIntWidth(t.tm_sec, p, TimeFieldLen::Second);
+
+    std::string archive = path_ + std::string(suffix, p - suffix);
+    struct stat st;
+    for (int seq = 1; ::stat(archive.c_str(), &st) == 0; ++seq)
+      archive = path_ + std::string(suffix, p - suffix) + "." +
+                std::to_string(seq);
+
+    return archive;
+  }
+
+  std::mutex mutex_;
+  std::string path_;
+  int fd_;
+  char *map_;
+  size_t offset_; // written bytes of current file.
+  size_t rotateSize_;
+  time_t rotateInterval_; // in seconds.
+  time_t openTime_;
+  time_t retryTime_; // to open the file again after a failure.
+};
+
+/// Write logs to a file in the background, so a slow disk does not stall the
+/// logging until all buffers are in flight. write() copies logs into a fixed
+/// buffer and returns, a buffer is submitted once it is full or no write is
+/// in flight, and recycled when the write completes. Writes are submitted to
+/// io_uring with registered buffers, or done by a write thread if io_uring is
+/// unavailable, e.g. old kernel or forbidden by seccomp. e.g.
+///   limlog::UringFileWriter::instance().open("app.log");
+///   limlog::singleton()->setOutput(limlog::UringFileWriter::write);
+class UringFileWriter {
+public:
+  static const size_t kBufferSize = 256 * 1024;
+  static const size_t kBufferCount = 8;
+
+  UringFileWriter()
+      : fd_(-1), offset_(0), storage_(nullptr), current_(nullptr),
+        inflight_(0), stop_(false), errors_(0), ringFd_(-1) {}
+  ~UringFileWriter() { close(); }
+
+  UringFileWriter(const UringFileWriter &) = delete;
+  UringFileWriter &operator=(const UringFileWriter &) = delete;
+
+  /// Writer used by write() and writev().
+  static UringFileWriter &instance() {
+    static UringFileWriter s_writer;
+    return s_writer;
+  }
+
+  /// OutputFunc writing to instance(), open it before logging.
+  static ssize_t write(const char *data, size_t n) {
+    return instance().append(data, n);
+  }
+
+  /// OutputVecFunc writing to instance(), open it before logging.
+  static ssize_t writev(const struct iovec *iov, int cnt) {
+    ssize_t total = 0;
+    for (int i = 0; i < cnt; ++i) {
+      ssize_t r = instance().append(static_cast<const char *>(iov[i].iov_base),
+                                    iov[i].iov_len);
+      if (r < 0)
+        return total != 0 ? total : r;
+      total += r;
+    }
+    return total;
+  }
+
+  /// Open file \a path to append, with io_uring if \a uring and it is
+  /// available.
+  bool open(const std::string &path, bool uring = true) {
+    close();
+
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+      return false;
+    struct stat st;
+    offset_ = fstat(fd_, &st) == 0 ? st.st_size : 0;
+
+    void *m = mmap(nullptr, kBufferSize * kBufferCount, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) {
+      ::close(fd_);
+      fd_ = -1;
+      return false;
+    }
+    storage_ = static_cast<char *>(m);
+    for (size_t i = 0; i < kBufferCount; ++i) {
+      buffers_[i].data = storage_ + i * kBufferSize;
+      free_.push_back(&buffers_[i]);
+    }
+
+    stop_ = false;
+    if (uring && setupRing())
+      thread_ = std::thread(&UringFileWriter::completeLoop, this);
+    else
+      thread_ = std::thread(&UringFileWriter::writeLoop, this);
+    return true;
+  }
+
+  /// Copy \a n bytes \a data to buffer, wait for a free buffer if all are in
+  /// flight. Return -1 if file is not opened.
+  ssize_t append(const char *data, size_t n) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (fd_ < 0)
+      return -1;
+
+    size_t written = 0;
+    while (written < n) {
+      if (!current_) {
+        cond_.wait(lock, [this] { return !free_.empty(); });
+        current_ = free_.back();
+        free_.pop_back();
+        current_->len = 0;
+        current_->done = 0;
+        current_->offset = offset_;
+      }
+
+      size_t len = std::min(n - written, kBufferSize - current_->len);
+      memcpy(current_->data + current_->len, data + written, len);
+      current_->len += len;
+      offset_ += len;
+      written += len;
+      if (current_->len == kBufferSize)
+        submitCurrent();
+    }
+
+    if (inflight_ == 0)
+      submitCurrent();
+    return n;
+  }
+
+  /// Submit the buffered logs and wait for all writes to complete.
+  void flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    submitCurrent();
+    cond_.wait(lock, [this] { return inflight_ == 0; });
+  }
+
+  /// Flush and close file.
+  void close() {
+    if (fd_ < 0)
+      return;
+
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+      if (ringFd_ >= 0)
+        submitRing(nullptr); // wake up the completion thread.
+    }
+    cond_.notify_all();
+    thread_.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    closeRing();
+    munmap(storage_, kBufferSize * kBufferCount);
+    storage_ = nullptr;
+    free_.clear();
+    queue_.clear();
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  /// Whether writes are submitted to io_uring.
+  bool uring() const { return ringFd_ >= 0; }
+
+  /// Bytes failed to write.
+  uint64_t errors() const { return errors_; }
+
+private:
+  struct Buffer {
+    char *data;
+    size_t len;      // buffered bytes.
+    size_t done;     // written bytes.
+    uint64_t offset; // file offset of data.
+  };
+
+  /// Submit the current buffer if it is not empty, called with lock.
+  void submitCurrent() {
+    if (!current_ || current_->len == 0)
+      return;
+
+    inflight_++;
+    if (ringFd_ >= 0) {
+      submitRing(current_);
+    } else {
+      queue_.push_back(current_);
+      cond_.notify_all();
+    }
+    current_ = nullptr;
+  }
+
+  /// Recycle buffer \a b written with result \a res , or submit the rest of
+  /// it after a partial write. Called with lock.
+  void complete(Buffer *b, ssize_t res) {
+    if (res > 0 && b->done + res < b->len) {
+      b->done += res;
+      if (ringFd_ >= 0)
+        submitRing(b);
+      else
+        queue_.push_front(b);
+      return;
+    }
+
+    if (res <= 0)
+      errors_ += b->len - b->done;
+    free_.push_back(b);
+    inflight_--;
+
+    // submit the logs buffered meanwhile.
+    if (inflight_ == 0)
+      submitCurrent();
+    cond_.notify_all();
+  }
+
+  /// Fallback without io_uring, write the submitted buffers in order.
+  void writeLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty())
+        break;
+
+      Buffer *b = queue_.front();
+      queue_.pop_front();
+      lock.unlock();
+      ssize_t res = pwriteBuffer(b);
+      lock.lock();
+      complete(b, res);
+    }
+  }
+
+  /// Write the rest of buffer \a b by pwrite, called without lock.
+  ssize_t pwriteBuffer(Buffer *b) {
+    ssize_t res;
+    do {
+      res = pwrite(fd_, b->data + b->done, b->len - b->done,
+                   b->offset + b->done);
+    } while (res < 0 && errno == EINTR);
+    return res;
+  }
+
+#ifdef LIMLOG_HAS_IO_URING
+  /// Create io_uring and register the buffers, fixed writes need no page
+  /// pinning each time. Unregistered buffers are used if locked memory is
+  /// limited, or the write thread if IORING_OP_WRITE is not supported either
+  /// (before Linux 5.6).
+  bool setupRing() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = static_cast<int>(
+        syscall(__NR_io_uring_setup, kBufferCount * 2, &p));
+    if (fd < 0)
+      return false;
+
+    sqMapSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqMapSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+      sqMapSize_ = cqMapSize_ = std::max(sqMapSize_, cqMapSize_);
+    sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    sqMap_ = mmap(nullptr, sqMapSize_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cqMap_ = (p.features & IORING_FEAT_SINGLE_MMAP)
+                 ? sqMap_
+                 : mmap(nullptr, cqMapSize_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    ringFd_ = fd;
+    if (sqMap_ == MAP_FAILED || cqMap_ == MAP_FAILED || sqes == MAP_FAILED) {
+      sqes_ = sqes == MAP_FAILED ? nullptr : sqes;
+      closeRing();
+      return false;
+    }
+    sqes_ = sqes;
+
+    char *sq = static_cast<char *>(sqMap_);
+    char *cq = static_cast<char *>(cqMap_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+
+    struct iovec iov = {storage_, kBufferSize * kBufferCount};
+    fixed_ = syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_BUFFERS,
+                     &iov, 1) == 0;
+    if (!fixed_ && !probeWrite()) {
+      closeRing();
+      return false;
+    }
+    return true;
+  }
+
+  /// Whether IORING_OP_WRITE is supported, the probe is added with it.
+  bool probeWrite() {
+    const size_t kOps = 256;
+    const size_t kSize = sizeof(struct io_uring_probe) +
+                         kOps * sizeof(struct io_uring_probe_op);
+    std::unique_ptr<char[]> buf(new char[kSize]());
+    auto *probe = reinterpret_cast<struct io_uring_probe *>(buf.get());
+    if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PROBE, probe,
+                kOps) != 0)
+      return false;
+    return probe->last_op >= IORING_OP_WRITE &&
+           (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  void closeRing() {
+    if (ringFd_ < 0)
+      return;
+    if (sqes_)
+      munmap(sqes_, sqesSize_);
+    if (cqMap_ != MAP_FAILED && cqMap_ != sqMap_)
+      munmap(cqMap_, cqMapSize_);
+    if (sqMap_ != MAP_FAILED)
+      munmap(sqMap_, sqMapSize_);
+    sqes_ = nullptr;
+    ::close(ringFd_);
+    ringFd_ = -1;
+  }
+
+  /// Submit a write of the rest of buffer \a b , or a nop to wake up the
+  /// completion thread if it is null. Called with lock, the only producer of
+  /// submission queue.
+  void submitRing(Buffer *b) {
+    unsigned tail = *sqTail_;
+    unsigned idx = tail & sqMask_;
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + idx;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = reinterpret_cast<uintptr_t>(b);
+    if (!b) {
+      sqe->opcode = IORING_OP_NOP;
+    } else {
+      sqe->opcode = fixed_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+      sqe->fd = fd_;
+      sqe->off = b->offset + b->done;
+      sqe->addr = reinterpret_cast<uintptr_t>(b->data + b->done);
+      sqe->len = static_cast<uint32_t>(b->len - b->done);
+      sqe->buf_index = 0;
+    }
+    sqArray_[idx] = idx;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+    // the entries not consumed by a failed call are submitted next time.
+    unsigned pending = tail + 1 - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    while (syscall(__NR_io_uring_enter, ringFd_, pending, 0, 0, nullptr, 0) <
+               0 &&
+           errno == EINTR)
+      ;
+  }
+
+  /// Wait for completions and recycle the buffers until stopped. A write
+  /// rejected by io_uring, e.g. the file does not support it, is done by
+  /// pwrite here rather than dropped.
+  void completeLoop() {
+    for (;;) {
+      unsigned head = *cqHead_;
+      if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE))
+        syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS,
+                nullptr, 0);
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; ++head) {
+        struct io_uring_cqe *cqe = &cqes_[head & cqMask_];
+        Buffer *b = reinterpret_cast<Buffer *>(cqe->user_data);
+        ssize_t res = cqe->res;
+        if (b && res == -EINVAL) {
+          lock.unlock();
+          res = pwriteBuffer(b);
+          lock.lock();
+        }
+        if (b && (res == -EINTR || res == -EAGAIN))
+          submitRing(b);
+        else if (b)
+          complete(b, res);
+      }
+      __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+
+      if (stop_ && inflight_ == 0)
+        break;
+    }
+  }
+#else
+  bool setupRing() { return false; }
+  void closeRing() {}
+  void submitRing(Buffer *b) {}
+  void completeLoop() {}
+#endif
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  int fd_;
+  uint64_t offset_; // file offset of the next log.
+  char *storage_;   // buffers in one mapping, registered at once.
+  Buffer buffers_[kBufferCount];
+  std::vector<Buffer *> free_;
+  std::deque<Buffer *> queue_; // submitted to write thread.
+  Buffer *current_;            // buffer being filled.
+  size_t inflight_;            // submitted buffers.
+  bool stop_;
+  std::atomic<uint64_t> errors_;
+  std::thread thread_; // completion thread or write thread.
+
+  int ringFd_;
+#ifdef LIMLOG_HAS_IO_URING
+  bool fixed_; // buffers are registered.
+  void *sqMap_;
+  void *cqMap_;
+  void *sqes_;
+  size_t sqMapSize_;
+  size_t cqMapSize_;
+  size_t sqesSize_;
+  unsigned *sqHead_;
+  unsigned *sqTail_;
+  unsigned sqMask_;
+  unsigned *sqArray_;
+  unsigned *cqHead_;
+  unsigned *cqTail_;
+  unsigned cqMask_;
+  struct io_uring_cqe *cqes_;
+#endif
+};
+#endif
+
+/// Min length of a match in compressBlock().
+static constexpr size_t kMinMatch = 4;
+
+/// Bytes at the end of a block which are always literals, and the distance
+/// from the start of the last match to the end, as the LZ4 block format.
+static constexpr size_t kLastLiterals = 5;
+static constexpr size_t kMatchLimit = 12;
+
+/// Bits of the hash table of compressBlock().
+static constexpr size_t kCompressHashBits = 12;
+
+/// Max length of \a n bytes compressed by compressBlock().
+inline size_t compressBound(size_t n) { return n + n / 255 + 16; }
+
+/// Write \a len beyond 15 of a token as bytes of 255 and a last byte.
+inline uint8_t *writeLength(uint8_t *o, size_t len) {
+  for (; len >= 255; len -= 255)
+    *o++ = 255;
+  *o++ = static_cast<uint8_t>(len);
+  return o;
+}
+
+/// Read the length beyond 15 of a token to \a len , return false if it is
+/// incomplete or larger than \a max .
+inline bool readLength(const uint8_t *&p, const uint8_t *end, size_t max,
+                       size_t *len) {
+  uint8_t b;
+  do {
+    if (p == end || *len > max)
+      return false;
+    b = *p++;
+    *len += b;
+  } while (b == 255);
+  return *len <= max;
+}
+
+/// Compress \a n bytes \a src to \a dst of compressBound() bytes in the LZ4
+/// block format, return the compressed length. Each sequence is a token of
+/// the literal length (high 4 bits) and the match length minus kMinMatch (low
+/// 4 bits), the literals, 2 bytes little endian offset of the match and the
+/// extended match length, and the last sequence has only literals. Matches
+/// are found greedily by a hash table of 4 bytes, without a dictionary across
+/// blocks.
+inline size_t compressBlock(const char *src, size_t n, char *dst) {
+  const uint8_t *base = reinterpret_cast<const uint8_t *>(src);
+  const uint8_t *end = base + n;
+  const uint8_t *anchor = base; // start of literals.
+  uint8_t *o = reinterpret_cast<uint8_t *>(dst);
+
+  if (n > kMatchLimit) {
+    uint32_t table[1 << kCompressHashBits];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t *p = base;
+    const uint8_t *limit = end - kMatchLimit; // last start of a match.
+    const uint8_t *matchEnd = end - kLastLiterals;
+    while (p < limit) {
+      uint32_t v, r;
+      memcpy(&v, p, sizeof(v));
+      uint32_t h = (v * 2654435761u) >> (32 - kCompressHashBits);
+      const uint8_t *ref = base + table[h];
+      table[h] = static_cast<uint32_t>(p - base);
+      memcpy(&r, ref, sizeof(r));
+      if (ref >= p || p - ref > 0xFFFF || r != v) {
+        p += 1 + ((p - anchor) >> 6); // faster on incompressible data.
+        continue;
+      }
+
+      while (p > anchor && ref > base && p[-1] == ref[-1]) {
+        p--;
+        ref--;
+      }
+      const uint8_t *m = p + kMinMatch;
+      while (m < matchEnd && *m == ref[m - p])
+        m++;
+
+      size_t lit = p - anchor;
+      size_t len = m - p - kMinMatch;
+      uint8_t *token = o++;
+      *token = static_cast<uint8_t>(std::min<size_t>(lit, 15) << 4 |
+                                    std::min<size_t>(len, 15));
+      if (lit >= 15)
+        o = writeLength(o, lit - 15);
+      memcpy(o, anchor, lit);
+      o += lit;
+      o[0] = static_cast<uint8_t>(p - ref);
+      o[1] = static_cast<uint8_t>((p - ref) >> 8);
+      o += 2;
+      if (len >= 15)
+        o = writeLength(o, len - 15);
+
+      p = anchor = m;
+    }
+  }
+
+  size_t lit = end - anchor;
+  *o++ = static_cast<uint8_t>(std::min<size_t>(lit, 15) << 4);
+  if (lit >= 15)
+    o = writeLength(o, lit - 15);
+  memcpy(o, anchor, lit);
+  o += lit;
+  return o - reinterpret_cast<uint8_t *>(dst);
+}
+
+/// Decompress \a n bytes \a src compressed by compressBlock() to \a dst of
+/// \a cap bytes, return the decompressed length, or -1 if it is corrupted.
+inline ssize_t decompressBlock(const char *src, size_t n, char *dst,
+                               size_t cap) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(src);
+  const uint8_t *end = p + n;
+  uint8_t *begin = reinterpret_cast<uint8_t *>(dst);
+  uint8_t *o = begin;
+  uint8_t *oend = begin + cap;
+
+  while (p < end) {
+    uint8_t token = *p++;
+    size_t lit = token >> 4;
+    if (lit == 15 && !readLength(p, end, cap, &lit))
+      return -1;
+    if (static_cast<size_t>(end - p) < lit ||
+        static_cast<size_t>(oend - o) < lit)
+      return -1;
+    memcpy(o, p, lit);
+    o += lit;
+    p += lit;
+    if (p == end)
+      return o - begin;
+
+    if (end - p < 2)
+      return -1;
+    size_t offset = p[0] | p[1] << 8;
+    p += 2;
+    size_t len = token & 15;
+    if (len == 15 && !readLength(p, end, cap, &len))
+      return -1;
+    len += kMinMatch;
+    if (offset == 0 || offset > static_cast<size_t>(o - begin) ||
+        static_cast<size_t>(oend - o) < len)
+      return -1;
+
+    // the match overlaps the output if offset is less than its length.
+    const uint8_t *ref = o - offset;
+    if (offset >= len) {
+      memcpy(o, ref, len);
+      o += len;
+    } else {
+      for (size_t i = 0; i < len; ++i)
+        *o++ = *ref++;
+    }
+  }
+  return -1; // the last sequence has literals only.
+}
+
+/// Header of a frame written by FrameCompressor, little endian.
+// Frame format.
+//  +-------+-----+--------+-------+---------------------------+
+//  | magic | raw | stored | check | stored bytes of the block |
+//  +-------+-----+--------+-------+---------------------------+
+struct FrameHeader {
+  static const uint32_t kMagic = 0x315a4c4c; // "LLZ1".
+  static const uint32_t kStored = 1u << 31;  // block is not compressed.
+
+  /// Hash of the other fields, so that a false magic in the corrupted data
+  /// is unlikely to be taken as a frame.
+  uint32_t hash() const {
+    uint64_t h = (static_cast<uint64_t>(raw) << 32 | stored) ^ magic;
+    h *= 0x9E3779B97F4A7C15ull;
+    return static_cast<uint32_t>(h >> 32);
+  }
+
+  /// Bytes of the block following the header.
+  uint32_t blockLen() const { return stored & ~kStored; }
+
+  uint32_t magic;
+  uint32_t raw;    // length of decompressed data.
+  uint32_t stored; // length of the block and kStored.
+  uint32_t check;  // hash().
+};
+
+/// Max raw bytes in a frame.
+static constexpr size_t kFrameSize = 64 * 1024;
+
+/// Compress logs to frames of up to kFrameSize raw bytes and output them.
+/// Every frame is decompressed independently, so a truncated or partly
+/// corrupted file is still readable, see FrameDecoder and the LogDecompressor
+/// tool. Data of an output call is compressed in the call, so batched output
+/// (async mode or FlushPolicy) compresses better. e.g.
+///   limlog::FrameCompressor::instance().setOutput(limlog::FdWriter::write);
+///   limlog::singleton()->setOutput(limlog::FrameCompressor::writev);
+class FrameCompressor {
+public:
+  FrameCompressor()
+      : output_(StdoutWriter::write), raw_(new char[kFrameSize]), rawLen_(0),
+        frame_(new char[sizeof(FrameHeader) + compressBound(kFrameSize)]),
+        rawBytes_(0), bytes_(0) {}
+
+  FrameCompressor(const FrameCompressor &) = delete;
+  FrameCompressor &operator=(const FrameCompressor &) = delete;
+
+  /// Compressor used by write() and writev().
+  static FrameCompressor &instance() {
+    static FrameCompressor s_compressor;
+    return s_compressor;
+  }
+
+  /// OutputFunc compressing with instance().
+  static ssize_t write(const char *data, size_t n) {
+    struct iovec iov = {const_cast<char *>(data), n};
+    return instance().compress(&iov, 1);
+  }
+
+  /// OutputVecFunc compressing with instance(), segments of an output are
+  /// compressed together.
+  static ssize_t writev(const struct iovec *iov, int cnt) {
+    return instance().compress(iov, cnt);
+  }
+
+  /// Set output \a w of frames.
+  void setOutput(OutputFunc w) { output_ = w; }
+
+  /// Compress \a cnt segments \a iov and output the frames. Return the raw
+  /// bytes, or -1 if the output of any frame failed.
+  ssize_t compress(const struct iovec *iov, int cnt) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool ok = true;
+    size_t total = 0;
+    for (int i = 0; i < cnt; ++i) {
+      const char *p = static_cast<const char *>(iov[i].iov_base);
+      size_t n = iov[i].iov_len;
+      total += n;
+      while (n > 0) {
+        size_t len = std::min(n, kFrameSize - rawLen_);
+        memcpy(raw_.get() + rawLen_, p, len);
+        rawLen_ += len;
+        p += len;
+        n -= len;
+        if (rawLen_ == kFrameSize)
+          ok &= outputFrame();
+      }
+    }
+    if (rawLen_ != 0)
+      ok &= outputFrame();
+    return ok ? static_cast<ssize_t>(total) : -1;
+  }
+
+  /// Bytes compressed.
+  uint64_t rawBytes() const { return rawBytes_; }
+
+  /// Bytes of the frames output.
+  uint64_t bytes() const { return bytes_; }
+
+private:
+  /// Compress the raw data to a frame and output it, the block is stored raw
+  /// if it is not smaller.
+  bool outputFrame() {
+    FrameHeader h;
+    char *block = frame_.get() + sizeof(h);
+    size_t len = compressBlock(raw_.get(), rawLen_, block);
+    h.stored = static_cast<uint32_t>(len);
+    if (len >= rawLen_) {
+      memcpy(block, raw_.get(), rawLen_);
+      len = rawLen_;
+      h.stored = static_cast<uint32_t>(len) | FrameHeader::kStored;
+    }
+    h.magic = FrameHeader::kMagic;
+    h.raw = static_cast<uint32_t>(rawLen_);
+    h.check = h.hash();
+    memcpy(frame_.get(), &h, sizeof(h));
+
+    size_t n = sizeof(h) + len;
+    rawBytes_ += rawLen_;
+    bytes_ += n;
+    rawLen_ = 0;
+    return output_(frame_.get(), n) == static_cast<ssize_t>(n);
+  }
+
+  std::mutex mutex_;
+  OutputFunc output_;
+  std::unique_ptr<char[]> raw_; // data of the frame being filled.
+  size_t rawLen_;
+  std::unique_ptr<char[]> frame_; // header and block.
+  std::atomic<uint64_t> rawBytes_;
+  std::atomic<uint64_t> bytes_;
+};
+
+/// Decode frames written by FrameCompressor and output the decompressed data.
+class FrameDecoder {
+public:
+  FrameDecoder()
+      : output_(StdoutWriter::write), raw_(new char[kFrameSize]), skipped_(0) {
+  }
+
+  FrameDecoder(const FrameDecoder &) = delete;
+  FrameDecoder &operator=(const FrameDecoder &) = delete;
+
+  /// Set output \a w of decompressed data.
+  void setOutput(OutputFunc w) { output_ = w; }
+
+  /// Decode \a n bytes \a data and output the data of complete frames. A
+  /// corrupted frame is skipped to the next frame magic, return -1 if any
+  /// bytes are skipped.
+  ssize_t decode(const char *data, size_t n) {
+    const char *p = data;
+    const char *end = data + n;
+    if (!pending_.empty()) {
+      pending_.append(data, n);
+      p = pending_.data();
+      end = p + pending_.size();
+    }
+
+    bool ok = true;
+    while (static_cast<size_t>(end - p) >= sizeof(FrameHeader)) {
+      FrameHeader h;
+      memcpy(&h, p, sizeof(h));
+      if (h.magic != FrameHeader::kMagic || h.check != h.hash() ||
+          h.raw > kFrameSize || h.blockLen() > compressBound(kFrameSize)) {
+        ok = false;
+        p = skip(p + 1, end);
+        continue;
+      }
+
+      const char *block = p + sizeof(h);
+      if (static_cast<size_t>(end - block) < h.blockLen())
+        break;
+
+      ssize_t len = h.blockLen();
+      if (h.stored & FrameHeader::kStored) {
+        if (h.blockLen() != h.raw)
+          len = -1;
+        else
+          memcpy(raw_.get(), block, len);
+      } else {
+        len = decompressBlock(block, h.blockLen(), raw_.get(), kFrameSize);
+      }
+      if (len != static_cast<ssize_t>(h.raw)) {
+        ok = false;
+        p = skip(p + 1, end);
+        continue;
+      }
+
+      if (len != 0)
+        output_(raw_.get(), len);
+      p = block + h.blockLen();
+    }
+
+    std::string rest(p, end);
+    pending_.swap(rest);
+    return ok ? static_cast<ssize_t>(n) : -1;
+  }
+
+  /// Bytes of the incomplete frame waiting for the rest.
+  size_t pending() const { return pending_.size(); }
+
+  /// Bytes skipped in the corrupted data.
+  uint64_t skipped() const { return skipped_; }
+
+private:
+  /// Return the next frame magic in [\a p, \a end) , or the last bytes which
+  /// may be the start of the magic, and count the skipped bytes.
+  const char *skip(const char *p, const char *end) {
+    const char *q = p;
+    for (; end - q >= 4; ++q) {
+      uint32_t magic;
+      memcpy(&magic, q, sizeof(magic));
+      if (magic == FrameHeader::kMagic)
+        break;
+    }
+    skipped_ += q - p + 1;
+    return q;
+  }
+
+  OutputFunc output_;
+  std::unique_ptr<char[]> raw_;
+  std::string pending_;
+  uint64_t skipped_;
+};
+
+/// Conditions to output the batched logs of SyncLogger, output once any of
+/// them is hit. Zero value means the condition is unused, and the default
+/// policy outputs every log immediately.
+struct FlushPolicy {
+  FlushPolicy() : FlushPolicy(0, 0, std::chrono::milliseconds(0)) {}
+
+  FlushPolicy(uint32_t bytes, uint32_t lines,
+              std::chrono::milliseconds interval)
+      : bytes(bytes), lines(lines), interval(interval) {}
+
+  /// Whether the logs are batched in buffer.
+  bool batched() const {
+    return bytes != 0 || lines != 0 || interval.count() != 0;
+  }
+
+  uint32_t bytes;                     // batched bytes.
+  uint32_t lines;                     // batched lines.
+  std::chrono::milliseconds interval; // elapsed since the first batched log.
+};
+
+/// What to do when a log does not fit in the unused space of BlockingBuffer.
+enum OverflowPolicy : uint8_t {
+  kBlock,          // wait for the consumer, spin, then yield, then sleep.
+  kDropNewest,     // drop the log being written and count it.
+  kOverwriteOldest // discard the logs not consumed yet, or drop if still full.
+};
+
+/// Counter written by a single thread and read by others, so it is a relaxed
+/// load and store rather than an atomic read-modify-write.
+class StatCounter {
+public:
+  StatCounter() : v_(0) {}
+
+  void add(uint64_t n) {
+    v_.store(v_.load(std::memory_order_relaxed) + n,
+             std::memory_order_relaxed);
+  }
+
+  void updateMax(uint64_t n) {
+    if (n > v_.load(std::memory_order_relaxed))
+      v_.store(n, std::memory_order_relaxed);
+  }
+
+  uint64_t get() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> v_;
+};
+
+/// Statistics of a logger, or the sum of loggers, see LimLog::stats().
+struct LogStats {
+  LogStats()
+      : tid(0), lines(0), bytes(0), dropped(0), discarded(0), blocked(0),
+        blockedNs(0), highWater(0), outputs(0), outputBytes(0), outputNs(0),
+        maxOutputNs(0) {}
+
+  /// Add \a s , the high water and max output time are the max of both.
+  LogStats &operator+=(const LogStats &s) {
+    lines += s.lines;
+    bytes += s.bytes;
+    dropped += s.dropped;
+    discarded += s.discarded;
+    blocked += s.blocked;
+    blockedNs += s.blockedNs;
+    highWater = std::max(highWater, s.highWater);
+    outputs += s.outputs;
+    outputBytes += s.outputBytes;
+    outputNs += s.outputNs;
+    maxOutputNs = std::max(maxOutputNs, s.maxOutputNs);
+    return *this;
+  }
+
+  thread_id_t tid;       // thread holding the logger, 0 if retired or sum.
+  uint64_t lines;        // complete logs.
+  uint64_t bytes;        // bytes of complete logs.
+  uint64_t dropped;      // logs dropped by overflow policy.
+  uint64_t discarded;    // bytes of logs discarded by kOverwriteOldest.
+  uint64_t blocked;      // times waiting for buffer space by kBlock.
+  uint64_t blockedNs;    // time waiting for buffer space.
+  uint64_t highWater;    // max used bytes of buffer, sampled by AsyncLogger.
+  uint64_t outputs;      // output calls.
+  uint64_t outputBytes;  // bytes output.
+  uint64_t outputNs;     // time in output calls, if timed.
+  uint64_t maxOutputNs;  // max time of an output call, if timed.
+};
+
+/// Counters of LogStats, each is written by one thread only: the logging
+/// thread of the logger, or the background thread for its output.
+struct StatCounters {
+  /// Call \a w to output \a n bytes \a data and count it, time it if
+  /// \a timed .
+  void output(OutputFunc w, const char *data, size_t n, bool timed) {
+    timedOutput(n, timed, [=] { w(data, n); });
+  }
+
+  /// Output \a cnt segments \a iov by \a v in a call, or by \a w one by one
+  /// if \a v is null. See output().
+  void output(OutputFunc w, OutputVecFunc v, const struct iovec *iov, int cnt,
+              bool timed) {
+    if (!v) {
+      for (int i = 0; i < cnt; ++i)
+        output(w, static_cast<const char *>(iov[i].iov_base), iov[i].iov_len,
+               timed);
+      return;
+    }
+
+    size_t n = 0;
+    for (int i = 0; i < cnt; ++i)
+      n += iov[i].iov_len;
+    timedOutput(n, timed, [=] { v(iov, cnt); });
+  }
+
+  LogStats load() const {
+    LogStats s;
+    s.lines = lines.get();
+    s.bytes = bytes.get();
+    s.dropped = dropped.get();
+    s.discarded = discarded.get();
+    s.blocked = blocked.get();
+    s.blockedNs = blockedNs.get();
+    s.highWater = highWater.get();
+    s.outputs = outputs.get();
+    s.outputBytes = outputBytes.get();
+    s.outputNs = outputNs.get();
+    s.maxOutputNs = maxOutputNs.get();
+    return s;
+  }
+
+  StatCounter lines;
+  StatCounter bytes;
+  StatCounter dropped;
+  StatCounter discarded;
+  StatCounter blocked;
+  StatCounter blockedNs;
+  StatCounter highWater;
+  StatCounter outputs;
+  StatCounter outputBytes;
+  StatCounter outputNs;
+  StatCounter maxOutputNs;
+
+private:
+  template <typename F> void timedOutput(size_t n, bool timed, F f) {
+    outputs.add(1);
+    outputBytes.add(n);
+    if (!timed) {
+      f();
+      return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    f();
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    outputNs.add(ns);
+    maxOutputNs.updateMax(ns);
+  }
+};
+
+/// Wakes up the background thread of LimLog sleeping while all loggers are
+/// empty, the logging thread checks \a idle after a log is complete.
+/// The background thread marks \a idle and checks the loggers again before
+/// sleeping, each side has a fence between its store and load, so either the
+/// log is seen by the background thread or \a idle is seen by the logging
+/// thread, and no wakeup is lost.
+struct BackendWakeup {
+  BackendWakeup() : idle(false) {}
+
+  /// Notify the background thread if it is idle, called after a log is
+  /// complete.
+  void wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!idle.load(std::memory_order_relaxed))
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      idle.store(false, std::memory_order_relaxed);
+    }
+    cond.notify_one();
+  }
+
+  std::atomic<bool> idle;
+  std::mutex mutex;
+  std::condition_variable cond;
+};
+
+class SyncLogger {
+public:
+  /// Output is done in the logging thread.
+  static constexpr bool kAsync = false;
+
+  SyncLogger()
+      : output_(StdoutWriter::write), outputVec_(nullptr), overflow_(kBlock),
+        dropping_(false), timed_(false), lines_(0), bypassed_(0),
+        baseSize_(BlockingBuffer::kDefaultSize),
+        maxSize_(BlockingBuffer::kDefaultSize), buffer_(new BlockingBuffer) {}
+
+  void setOutput(OutputFunc w) {
+    output_ = w;
+    outputVec_ = nullptr;
+  }
+
+  /// Output the incomplete log and the log larger than buffer in a call.
+  void setOutput(OutputVecFunc w) { outputVec_ = w; }
+
+  /// Measure time of output calls if \a timed .
+  void setOutputTiming(bool timed) { timed_ = timed; }
+
+  void setFlushPolicy(const FlushPolicy &policy) { policy_ = policy; }
+
+  /// Logs are output in the logging thread.
+  void setWakeup(BackendWakeup *wakeup) {}
+
+  /// Batched logs are always output to make room, the policy only applies to
+  /// the log larger than buffer: kBlock outputs it in pieces directly, others
+  /// drop it.
+  void setOverflowPolicy(OverflowPolicy policy) { overflow_ = policy; }
+
+  /// Dropped logs.
+  uint64_t dropped() const { return stats_.dropped.get(); }
+
+  /// Batched logs are never discarded.
+  uint64_t discarded() const { return 0; }
+
+  /// Statistics, read by other threads.
+  LogStats stats() const { return stats_.load(); }
+
+  /// Set buffer \a size , and it grows up to \a maxSize for the log larger
+  /// than buffer, then shrinks back once idle.
+  /// See BlockingBuffer::roundUpSize().
+  void setBufferSize(uint32_t size, uint32_t maxSize) {
+    baseSize_ = BlockingBuffer::roundUpSize(size);
+    maxSize_ = std::max(baseSize_, BlockingBuffer::roundUpSize(maxSize));
+    flush();
+    if (buffer_->size() != baseSize_ && buffer_->incomplete() <= baseSize_)
+      resize(baseSize_);
+  }
+
+  /// Current buffer size.
+  uint32_t bufferSize() const { return buffer_->size(); }
+
+  /// Logs are output in order, the time is not needed.
+  void begin(int64_t time) {}
+
+  void produce(const char *data, size_t n) {
+    if (dropping_)
+      return;
+
+    // output the batched logs to make room for this one, and keep logs from
+    // wrapping around so they are output in one piece.
+    if (buffer_->unusedToEnd() < n) {
+      flush();
+      if (buffer_->unusedToEnd() < n)
+        grow(buffer_->incomplete() + n);
+    }
+
+    if (buffer_->unusedToEnd() >= n) {
+      buffer_->produce(data, n);
+      return;
+    }
+
+    // the log is larger than buffer.
+    if (overflow_ != kBlock) {
+      dropping_ = true;
+      return;
+    }
+
+    // output the incomplete log and data directly.
+    stats_.highWater.updateMax(buffer_->used() + n);
+    struct iovec iov[2] = {{buffer_->data(), buffer_->used()},
+                           {const_cast<char *>(data), n}};
+    stats_.output(output_, outputVec_, iov, 2, timed_);
+    bypassed_ += buffer_->used() + n;
+    buffer_->reset();
+  }
+
+  char *reserve(size_t n) {
+    if (dropping_)
+      return nullptr;
+    if (buffer_->unusedToEnd() < n)
+      flush();
+    return buffer_->reserve(n);
+  }
+
+  void commit(size_t n) { buffer_->commit(n); }
+
+  /// Complete a logline with length \a n , output the batched logs if the
+  /// flush policy is hit.
+  /// The interval is only checked here, so call flush() to output the logs
+  /// left in buffer when the thread is idle.
+  void flush(size_t n) {
+    if (dropping_) {
+      buffer_->truncate();
+      dropping_ = false;
+      stats_.dropped.add(1);
+      return;
+    }
+
+    // part of the log may be output already in produce().
+    stats_.highWater.updateMax(buffer_->used());
+    buffer_->incConsumablePos(n - bypassed_);
+    bypassed_ = 0;
+    lines_++;
+    stats_.lines.add(1);
+    stats_.bytes.add(n);
+
+    if (!policy_.batched()) {
+      flush();
+      return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (lines_ == 1)
+      deadline_ = now + policy_.interval;
+
+    if ((policy_.bytes != 0 && buffer_->consumable() >= policy_.bytes) ||
+        (policy_.lines != 0 && lines_ >= policy_.lines) ||
+        (policy_.interval.count() != 0 && now >= deadline_))
+      flush();
+  }
+
+  /// Output all complete logs in buffer.
+  void flush() {
+    uint32_t n;
+    while ((n = buffer_->consumableToEnd()) != 0) {
+      struct iovec iov = {buffer_->data(), n};
+      stats_.output(output_, outputVec_, &iov, 1, timed_);
+      buffer_->consume(n);
+    }
+
+    // move the incomplete log to the beginning of buffer, so logs are output
+    // in one piece next time and not interleaved with other threads.
+    buffer_->rewind();
+    lines_ = 0;
+
+    // shrink the grown buffer if no large log comes for a while.
+    const auto kShrinkIdle = std::chrono::seconds(1);
+    if (buffer_->size() > baseSize_ && buffer_->incomplete() <= baseSize_ &&
+        std::chrono::steady_clock::now() - lastGrow_ >= kShrinkIdle)
+      resize(baseSize_);
+  }
+
+  /// Nothing to consume, log is output in flush().
+  bool front(int64_t *time, uint32_t *len) { return false; }
+  bool consume(char *to, uint32_t len) { return false; }
+
+private:
+  /// Grow buffer to hold \a n bytes if the max size allows.
+  void grow(size_t n) {
+    uint32_t size = buffer_->size();
+    while (size < n && size < maxSize_)
+      size <<= 1;
+    if (size >= n) {
+      resize(size);
+      lastGrow_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  /// Replace buffer with \a size , only the incomplete log is in buffer.
+  void resize(uint32_t size) {
+    std::unique_ptr<BlockingBuffer> buffer(new BlockingBuffer(size));
+    buffer_->moveIncomplete(buffer.get());
+    buffer_.swap(buffer);
+  }
+
+  OutputFunc output_;
+  OutputVecFunc outputVec_; // used instead of output_ if not null.
+  FlushPolicy policy_;
+  OverflowPolicy overflow_;
+  bool dropping_;     // the log being written is dropped.
+  bool timed_;        // output calls are timed.
+  uint32_t lines_;    // complete logs in buffer.
+  uint32_t bypassed_; // bytes of the log being written output directly.
+  uint32_t baseSize_;
+  uint32_t maxSize_;
+  std::chrono::steady_clock::time_point deadline_;
+  std::chrono::steady_clock::time_point lastGrow_;
+  std::unique_ptr<BlockingBuffer> buffer_;
+  StatCounters stats_;
+};
+
+/// Only copy log into BlockingBuffer of the logging thread, the background
+/// thread of LimLog consumes the complete logs and does the output.
+/// Each log is prefixed by a header with its length and time, so the
+/// background thread merges logs of all threads in time order.
+//  +------------+-----------+-----+
+//  | length (4) | time (8)  | log |
+//  +------------+-----------+-----+
+class AsyncLogger {
+public:
+  /// Output is done in the background thread.
+  static constexpr bool kAsync = true;
+
+  AsyncLogger()
+      : overflow_(kBlock), dropping_(false), depth_(0), lines_(0),
+        baseSize_(BlockingBuffer::kDefaultSize),
+        maxSize_(BlockingBuffer::kDefaultSize),
+        produceBuffer_(new BlockingBuffer), consumeBuffer_(produceBuffer_),
+        wakeup_(nullptr) {}
+
+  ~AsyncLogger() {
+    while (consumeBuffer_) {
+      BlockingBuffer *next = consumeBuffer_->next();
+      delete consumeBuffer_;
+      consumeBuffer_ = next;
+    }
+  }
+
+  AsyncLogger(const AsyncLogger &) = delete;
+  AsyncLogger &operator=(const AsyncLogger &) = delete;
+
+  /// Output is set to LimLog that used by the background thread.
+  void setOutput(OutputFunc w) {}
+  void setOutput(OutputVecFunc w) {}
+
+  /// Output is timed by LimLog.
+  void setOutputTiming(bool timed) {}
+
+  /// Background thread outputs logs in batch already.
+  void setFlushPolicy(const FlushPolicy &policy) {}
+
+  /// Wake up the background thread by \a wakeup once a log is complete.
+  void setWakeup(BackendWakeup *wakeup) { wakeup_ = wakeup; }
+
+  /// Set the policy when the background thread falls behind.
+  void setOverflowPolicy(OverflowPolicy policy) { overflow_ = policy; }
+
+  /// Dropped logs.
+  uint64_t dropped() const { return stats_.dropped.get(); }
+
+  /// Bytes of the logs discarded by kOverwriteOldest.
+  uint64_t discarded() const { return stats_.discarded.get(); }
+
+  /// Statistics, read by other threads. The output is counted by LimLog.
+  LogStats stats() const { return stats_.load(); }
+
+  /// Set buffer \a size , and it grows up to \a maxSize when it is full
+  /// before the overflow policy applies, then shrinks back once idle.
+  /// See BlockingBuffer::roundUpSize().
+  void setBufferSize(uint32_t size, uint32_t maxSize) {
+    baseSize_ = BlockingBuffer::roundUpSize(size);
+    maxSize_ = std::max(baseSize_, BlockingBuffer::roundUpSize(maxSize));
+    if (produceBuffer_->size() != baseSize_ &&
+        produceBuffer_->incomplete() <= baseSize_)
+      resize(baseSize_);
+  }
+
+  /// Current buffer size.
+  uint32_t bufferSize() const { return produceBuffer_->size(); }
+
+  /// Begin a logline with \a time , the nanoseconds since epoch. A log begun
+  /// while writing another, e.g. logged by a function called in the outer
+  /// log's arguments, is written aside and produced after the outer one.
+  void begin(int64_t time) {
+    char header[kHeaderSize] = {};
+    memcpy(header + sizeof(uint32_t), &time, sizeof(time));
+    if (depth_++ != 0) {
+      nested_.emplace_back(header, sizeof(header));
+      return;
+    }
+    produce(header, kHeaderSize);
+  }
+
+  void produce(const char *data, size_t n) {
+    if (depth_ == 0)
+      begin(Time::now().count());
+    if (depth_ > 1)
+      nested_.back().append(data, n);
+    else if (makeRoom(n))
+      produceBuffer_->produce(data, n);
+  }
+
+  /// Return nullptr for a nested log, it is formatted to a temporary.
+  char *reserve(size_t n) {
+    if (depth_ == 0)
+      begin(Time::now().count());
+    if (depth_ > 1)
+      return nullptr;
+    return makeRoom(n) ? produceBuffer_->reserve(n) : nullptr;
+  }
+
+  void commit(size_t n) { produceBuffer_->commit(n); }
+
+  /// Make a complete logline with length \a n visible to background thread,
+  /// or discard it if it is dropped. A nested log waits for the outer one.
+  void flush(size_t n) {
+    if (depth_ == 0)
+      begin(Time::now().count());
+
+    if (--depth_ != 0) {
+      uint32_t len = static_cast<uint32_t>(n);
+      std::string &record = nested_.back();
+      memcpy(&record[0], &len, sizeof(len));
+      completed_ += record;
+      nested_.pop_back();
+      return;
+    }
+
+    complete(n);
+    if (!completed_.empty())
+      produceNested();
+  }
+
+  /// Logs are output by the background thread.
+  void flush() {}
+
+  /// Get \a time and length \a len of the first complete log, called by the
+  /// background thread. Return false if there is none. Move to the next
+  /// buffer once the sealed one is consumed.
+  bool front(int64_t *time, uint32_t *len) {
+    char header[kHeaderSize];
+    for (;;) {
+      frontPos_ = consumeBuffer_->consumePos();
+      if (consumeBuffer_->read(frontPos_, header, kHeaderSize))
+        break;
+
+      BlockingBuffer *next = consumeBuffer_->next();
+      if (!next)
+        return false;
+
+      // logs completed before sealed are visible after next is loaded.
+      if (consumeBuffer_->read(frontPos_, header, kHeaderSize))
+        break;
+
+      delete consumeBuffer_;
+      consumeBuffer_ = next;
+    }
+
+    memcpy(len, header, sizeof(*len));
+    memcpy(time, header + sizeof(*len), sizeof(*time));
+
+    // never trust a length beyond the buffer, it is consumed next.
+    return *len <= consumeBuffer_->size() - kHeaderSize;
+  }
+
+  /// Consume the first complete log with length \a len got by front() to
+  /// \a to , called by the background thread. Return false if it is
+  /// discarded by the producer meanwhile.
+  bool consume(char *to, uint32_t len) {
+    return consumeBuffer_->read(frontPos_ + kHeaderSize, to, len) &&
+           consumeBuffer_->release(frontPos_, kHeaderSize + len);
+  }
+
+private:
+  /// Complete the outermost logline with length \a n .
+  void complete(size_t n) {
+    if (dropping_) {
+      produceBuffer_->truncate();
+      dropping_ = false;
+      stats_.dropped.add(1);
+      return;
+    }
+
+    uint32_t len = static_cast<uint32_t>(n);
+    produceBuffer_->patch(0, reinterpret_cast<const char *>(&len), sizeof(len));
+    produceBuffer_->incConsumablePos(kHeaderSize + len);
+    if (wakeup_)
+      wakeup_->wake();
+    stats_.lines.add(1);
+    stats_.bytes.add(n);
+
+    // used() reads the consume position written by the background thread, so
+    // the high water is sampled.
+    if (lines_ % kHighWaterSampleLines == 0)
+      stats_.highWater.updateMax(produceBuffer_->used());
+
+    // shrink the grown buffer if it is not full for a while, checked every
+    // kShrinkCheckLines logs.
+    const auto kShrinkIdle = std::chrono::seconds(1);
+    if (++lines_ % kShrinkCheckLines == 0 &&
+        produceBuffer_->size() > baseSize_ &&
+        produceBuffer_->used() <= baseSize_ / 2 &&
+        std::chrono::steady_clock::now() - lastFull_ >= kShrinkIdle)
+      resize(baseSize_);
+  }
+
+  /// Produce the nested logs completed while writing the outer one.
+  void produceNested() {
+    std::string records;
+    records.swap(completed_);
+    for (size_t i = 0; i < records.size();) {
+      uint32_t len;
+      int64_t time;
+      memcpy(&len, &records[i], sizeof(len));
+      memcpy(&time, &records[i + sizeof(len)], sizeof(time));
+      begin(time);
+      produce(&records[i + kHeaderSize], len);
+      flush(len);
+      i += kHeaderSize + len;
+    }
+  }
+
+  /// Make room for \a n bytes by growing the buffer or the overflow policy,
+  /// return false if the log being written is dropped.
+  bool makeRoom(size_t n) {
+    if (dropping_)
+      return false;
+    if (produceBuffer_->hasUnused(n))
+      return true;
+
+    lastFull_ = std::chrono::steady_clock::now();
+    stats_.highWater.updateMax(produceBuffer_->used());
+    if (grow(produceBuffer_->incomplete() + n))
+      return true;
+
+    // the incomplete log is never consumed, it never fits if exceeds buffer.
+    if (produceBuffer_->incomplete() + n <= produceBuffer_->size()) {
+      if (overflow_ == kBlock) {
+        produceBuffer_->waitUnused(n);
+        stats_.blocked.add(1);
+        stats_.blockedNs.add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - lastFull_)
+                .count());
+        return true;
+      }
+
+      if (overflow_ == kOverwriteOldest) {
+        stats_.discarded.add(produceBuffer_->discard());
+        if (produceBuffer_->hasUnused(n))
+          return true;
+      }
+    }
+
+    dropping_ = true;
+    return false;
+  }
+
+  /// Grow buffer to hold \a n bytes if the max size allows.
+  bool grow(size_t n) {
+    uint32_t size = produceBuffer_->size() << 1;
+    while (size < n && size < maxSize_)
+      size <<= 1;
+    if (size > maxSize_ || size < n)
+      return false;
+    resize(size);
+    return true;
+  }
+
+  /// Move to a new buffer with \a size , the incomplete log is moved to it
+  /// and the old one is left to the background thread.
+  void resize(uint32_t size) {
+    BlockingBuffer *buffer = new BlockingBuffer(size);
+    produceBuffer_->moveIncomplete(buffer);
+    produceBuffer_->seal(buffer);
+    produceBuffer_ = buffer;
+  }
+
+  static const uint32_t kShrinkCheckLines = 1024;
+  static const uint32_t kHighWaterSampleLines = 64;
+  static const uint32_t kHeaderSize = sizeof(uint32_t) + sizeof(int64_t);
+
+  OverflowPolicy overflow_;
+  bool dropping_; // the log being written is dropped.
+  uint32_t depth_;                  // logs begun, more than 1 if nested.
+  std::vector<std::string> nested_; // nested logs being written.
+  std::string completed_;           // nested logs to produce.
+  uint32_t lines_;
+  uint32_t baseSize_;
+  uint32_t maxSize_;
+  std::chrono::steady_clock::time_point lastFull_;
+  BlockingBuffer *produceBuffer_;
+  BlockingBuffer *consumeBuffer_; // used by the background thread.
+  uint32_t frontPos_;             // used by the background thread.
+  BackendWakeup *wakeup_;
+  StatCounters stats_;
+};
+
+/// Loggers of all threads of LimLog, an append-only intrusive list that
+/// threads register into and the background thread iterates without lock.
+/// Loggers of exited threads are retired and reused by new threads, so the
+/// memory is bounded by the max number of threads alive. It is owned by
+/// LimLog and destroyed with it, the thread exit guards only hold weak
+/// references: a guard locks it during a retire, and does nothing if LimLog
+/// is gone.
+template <typename Logger> class LoggerRegistry {
+public:
+  struct Node {
+    Node() : next(nullptr), active(true), tid(0) {}
+
+    Logger logger;
+    Node *next; // never changed after the node is published.
+    std::atomic<bool> active;
+    std::atomic<thread_id_t> tid; // thread holding the logger.
+    char pad[64];                 // not share cache line with other nodes.
+  };
+
+  LoggerRegistry() : head_(nullptr), retired_(0) {}
+
+  ~LoggerRegistry() {
+    Node *n = head_.load();
+    while (n) {
+      Node *next = n->next;
+      delete n;
+      n = next;
+    }
+  }
+
+  LoggerRegistry(const LoggerRegistry &) = delete;
+  LoggerRegistry &operator=(const LoggerRegistry &) = delete;
+
+  /// Reuse a retired logger or create a new one.
+  Node *acquire() {
+    // nodes are never removed, so a retired one is taken by CAS safely.
+    if (retired_.load(std::memory_order_relaxed) != 0) {
+      for (Node *n = head_.load(std::memory_order_acquire); n; n = n->next) {
+        bool active = false;
+        if (!n->active.load(std::memory_order_relaxed) &&
+            n->active.compare_exchange_strong(active, true,
+                                              std::memory_order_acquire)) {
+          retired_.fetch_sub(1, std::memory_order_relaxed);
+          return n;
+        }
+      }
+    }
+
+    Node *n = new Node;
+    n->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(n->next, n, std::memory_order_release,
+                                        std::memory_order_relaxed))
+      ;
+    return n;
+  }
+
+  /// Retire logger of node \a n of the exited thread, output its batched logs
+  /// first. The logs left of AsyncLogger are still consumed by background
+  /// thread.
+  void retire(Node *n) {
+    n->logger.flush();
+    n->active.store(false, std::memory_order_release);
+    retired_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// Call \a f with each logger, including the retired ones. Loggers
+  /// registered meanwhile may be missed.
+  template <typename F> void forEach(F f) {
+    forEachNode([&f](Node *n) { f(&n->logger); });
+  }
+
+  /// Call \a f with each node, see forEach().
+  template <typename F> void forEachNode(F f) {
+    for (Node *n = head_.load(std::memory_order_acquire); n; n = n->next)
+      f(n);
+  }
+
+private:
+  std::atomic<Node *> head_;
+  std::atomic<size_t> retired_; // hint to skip scan if none is retired.
+};
+
+/// Output formats of text log lines.
+enum LogFormat : uint8_t {
+  kTextFormat,   // LogPattern layout, strings are output as is.
+  kJsonFormat,   // a JSON object per line, e.g. {"level":"INFO",...}.
+  kLogfmtFormat, // key=value pairs per line, e.g. level=INFO ...
+};
+
+/// Max length of a byte escaped by escapeString(), i.e. "\u00XX".
+static constexpr size_t kMaxEscapeLen = 6;
+
+/// Bytes escaped once by appendEscaped().
+static constexpr size_t kEscapeChunk = 256;
+
+/// Length of the valid UTF-8 character starting at \a p before \a end , or 0 if
+/// it is invalid.
+inline size_t validUtf8Len(const uint8_t *p, const uint8_t *end) {
+  size_t len;
+  uint8_t lo = 0x80, hi = 0xBF; // range of the second byte.
+  if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+    len = 2;
+  } else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+    len = 3;
+    lo = p[0] == 0xE0 ? 0xA0 : lo; // overlong.
+    hi = p[0] == 0xED ? 0x9F : hi; // surrogates.
+  } else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+    len = 4;
+    lo = p[0] == 0xF0 ? 0x90 : lo; // overlong.
+    hi = p[0] == 0xF4 ? 0x8F : hi; // above U+10FFFF.
+  } else {
+    return 0;
+  }
+
+  if (static_cast<size_t>(end - p) < len || p[1] < lo || p[1] > hi)
+    return 0;
+  for (size_t i = 2; i < len; ++i)
+    if ((p[i] & 0xC0) != 0x80)
+      return 0;
+  return len;
+}
+
+/// Escape the byte at \a p , which is a quote, backslash, control character
+/// or the start of non-ASCII, to \a o . Both are advanced.
+inline void escapeByte(const uint8_t *&p, const uint8_t *end, char *&o) {
+  static constexpr char kHex[] = "0123456789abcdef";
+
+  uint8_t c = *p;
+  if (c >= 0x80) {
+    size_t len = validUtf8Len(p, end);
+    if (len != 0) {
+      memcpy(o, p, len);
+      o += len;
+      p += len;
+    } else {
+      memcpy(o, "\\ufffd", 6);
+      o += 6;
+      p++;
+    }
+    return;
+  }
+
+  p++;
+  *o++ = '\\';
+  switch (c) {
+  case '"':
+  case '\\':
+    *o++ = c;
+    break;
+  case '\n':
+    *o++ = 'n';
+    break;
+  case '\r':
+    *o++ = 'r';
+    break;
+  case '\t':
+    *o++ = 't';
+    break;
+  case '\b':
+    *o++ = 'b';
+    break;
+  case '\f':
+    *o++ = 'f';
+    break;
+  default:
+    memcpy(o, "u00", 3);
+    o[3] = kHex[c >> 4];
+    o[4] = kHex[c & 0xF];
+    o += 5;
+    break;
+  }
+}
+
+/// Escape \a n bytes \a data as the content of a JSON string to \a to , which
+/// has kMaxEscapeLen * n bytes at least. Quotes, backslashes and control
+/// characters are escaped, and invalid UTF-8 bytes are replaced by U+FFFD.
+/// Return the escaped length.
+/// 16 bytes are checked at once with SSE2, and copied if none is escaped.
+inline size_t escapeString(const char *data, size_t n, char *to) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+  const uint8_t *end = p + n;
+  char *o = to;
+
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(' ');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // non-ASCII bytes are negative in signed comparison.
+    __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmplt_epi8(v, space));
+    int mask = _mm_movemask_epi8(m);
+
+    // the output has room for 16 bytes, as at least 16 bytes are left.
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(o), v);
+    if (mask == 0) {
+      p += 16;
+      o += 16;
+      continue;
+    }
+
+    int k = __builtin_ctz(mask);
+    p += k;
+    o += k;
+    escapeByte(p, end, o);
+  }
+#endif
+
+  while (p < end) {
+    if (*p < ' ' || *p >= 0x80 || *p == '"' || *p == '\\')
+      escapeByte(p, end, o);
+    else
+      *o++ = static_cast<char>(*p++);
+  }
+
+  return o - to;
+}
+
+/// Append \a n bytes \a data escaped by escapeString() to \a out , which
+/// supports appendFormat<N>(format) like LogAppender. It is escaped in chunks
+/// split at the UTF-8 character boundaries.
+template <typename Out>
+inline void appendEscaped(Out &out, const char *data, size_t n) {
+  while (n > 0) {
+    size_t len = std::min(n, kEscapeChunk);
+    for (int i = 0; i < 3 && len < n && len > 1 &&
+                    (static_cast<uint8_t>(data[len]) & 0xC0) == 0x80;
+         ++i)
+      len--;
+
+    out.template appendFormat<kEscapeChunk * kMaxEscapeLen>(
+        [data, len](char *to) { return escapeString(data, len, to); });
+    data += len;
+    n -= len;
+  }
+}
+
+/// Append the separator and \a key of a field in \a format to \a out , which
+/// supports append(data, n). No separator for the \a first field.
+template <typename Out>
+inline void appendKey(Out &out, LogFormat format, const char *key,
+                      bool first) {
+  if (format == kJsonFormat) {
+    out.append(first ? "\"" : ",\"", first ? 1 : 2);
+    out.append(key, strlen(key));
+    out.append("\":", 2);
+  } else {
+    if (!first)
+      out.append(" ", 1);
+    out.append(key, strlen(key));
+    out.append("=", 1);
+  }
+}
+
+/// Append \a n bytes string value \a data in \a format to \a out , quoted and
+/// escaped unless in text.
+template <typename Out>
+inline void appendValue(Out &out, LogFormat format, const char *data,
+                        size_t n) {
+  if (format == kTextFormat) {
+    out.append(data, n);
+    return;
+  }
+  out.append("\"", 1);
+  appendEscaped(out, data, n);
+  out.append("\"", 1);
+}
+
+/// Field with key and value of log line, e.g.
+///   LOG_INFO << "login" << limlog::kv("user", id);
+template <typename T> struct KeyValue {
+  const char *key;
+  const T &value;
+};
+
+/// Field with \a key and value \a v , see LogLine::kv().
+template <typename T> inline KeyValue<T> kv(const char *key, const T &v) {
+  return KeyValue<T>{key, v};
+}
+
+/// Log Location, include file, function, line.
+struct LogLoc {
+public:
+  LogLoc() : LogLoc("", "", 0) {}
+
+  LogLoc(const char *file, const char *function, uint32_t line)
+      : file_(file), function_(function), line_(line) {}
+
+  bool empty() const { return line_ == 0; }
+
+  const char *file_;
+  const char *function_;
+  uint32_t line_;
+};
+
+/// Layout of the text log line, parsed once from a pattern string into a
+/// sequence of fields:
+///   %L level, %T time with optional fraction {s|ms|us|ns} (ms by default),
+///   %t thread id, %f file, %F function, %l line, %m message, %% '%'.
+/// The text right after an empty field is skipped, so "%f:%l " outputs nothing
+/// for the log without location. The message is at the end if %m is absent.
+/// In JSON and logfmt, the fields are output with keys level, time, tid, file,
+/// func, line and msg in the same order, the text and empty fields are
+/// skipped.
+class LogPattern {
+public:
+  explicit LogPattern(const std::string &pattern = "%L %T %t %f:%l %m")
+      : message_(0) {
+    bool hasMessage = false;
+    size_t i = 0;
+    while (i < pattern.size()) {
+      if (pattern[i] != '%' || i + 1 == pattern.size()) {
+        appendText(&pattern[i], 1);
+        i++;
+        continue;
+      }
+
+      char c = pattern[i + 1];
+      i += 2;
+      switch (c) {
+      case 'L':
+        ops_.push_back(Op{kLevel, 0, 0, 0});
+        break;
+      case 'T':
+        ops_.push_back(Op{kTime, SecFracLen::Milli, 0, 0});
+        i += parseFracLen(pattern, i, &ops_.back().fracLen);
+        break;
+      case 't':
+        ops_.push_back(Op{kThread, 0, 0, 0});
+        break;
+      case 'f':
+        ops_.push_back(Op{kFile, 0, 0, 0});
+        break;
+      case 'F':
+        ops_.push_back(Op{kFunction, 0, 0, 0});
+        break;
+      case 'l':
+        ops_.push_back(Op{kLine, 0, 0, 0});
+        break;
+      case 'm':
+        if (!hasMessage) {
+          message_ = ops_.size();
+          hasMessage = true;
+        }
+        break;
+      case '%':
+        appendText("%", 1);
+        break;
+      default:
+        appendText(&pattern[i - 2], 2);
+        break;
+      }
+    }
+
+    if (!hasMessage)
+      message_ = ops_.size();
+  }
+
+  /// Format the fields before the message if \a prefix , otherwise the ones
+  /// after it, of the log with \a level , \a time , thread id \a tid and
+  /// location \a loc in \a fmt to \a out , which supports append(data, n)
+  /// and appendFormat<N>(format) like LogAppender.
+  /// In JSON and logfmt, the message and the fields of caller are between the
+  /// prefix and suffix, return whether any field is output.
+  template <typename Out>
+  bool format(Out &out, bool prefix, LogFormat fmt, LogLevel level,
+              const Time &time, uint64_t tid, const LogLoc &loc) const {
+    if (fmt != kTextFormat)
+      return formatFields(out, prefix, fmt, level, time, tid, loc);
+
+    size_t begin = prefix ? 0 : message_;
+    size_t end = prefix ? message_ : ops_.size();
+    bool skip = false;
+
+    for (size_t i = begin; i < end; ++i) {
+      const Op &op = ops_[i];
+      if (op.field == kText) {
+        if (!skip)
+          out.append(&text_[op.offset], op.len);
+        skip = false;
+        continue;
+      }
+
+      skip = false;
+      switch (op.field) {
+      case kLevel:
+        out.append(stringifyLogLevel(level), 4);
+        break;
+      case kTime:
+        out.template appendFormat<Time::kMaxFormatLen>(
+            [&](char *to) { return time.formatTo(to, op.fracLen); });
+        break;
+      case kThread:
+        out.template appendFormat<20>(
+            [tid](char *to) { return formatInt(tid, to); });
+        break;
+      case kFile:
+        skip = *loc.file_ == '\0';
+        out.append(loc.file_, strlen(loc.file_));
+        break;
+      case kFunction:
+        skip = *loc.function_ == '\0';
+        out.append(loc.function_, strlen(loc.function_));
+        break;
+      case kLine:
+        skip = loc.empty();
+        if (!skip)
+          out.template appendFormat<10>(
+              [&loc](char *to) { return formatInt(loc.line_, to); });
+        break;
+      default:
+        break;
+      }
+    }
+    return false;
+  }
+
+private:
+  enum Field : uint8_t {
+    kText,
+    kLevel,
+    kTime,
+    kThread,
+    kFile,
+    kFunction,
+    kLine,
+  };
+
+  struct Op {
+    Field field;
+    uint8_t fracLen; // of time.
+    uint32_t offset; // of text in text_.
+    uint32_t len;    // of text.
+  };
+
+  /// Format fields in JSON or logfmt, see format().
+  template <typename Out>
+  bool formatFields(Out &out, bool prefix, LogFormat fmt, LogLevel level,
+                    const Time &time, uint64_t tid, const LogLoc &loc) const {
+    size_t begin = prefix ? 0 : message_;
+    size_t end = prefix ? message_ : ops_.size();
+    bool json = fmt == kJsonFormat;
+    bool first = prefix;
+
+    if (prefix && json)
+      out.append("{", 1);
+
+    for (size_t i = begin; i < end; ++i) {
+      const Op &op = ops_[i];
+      switch (op.field) {
+      case kLevel:
+        appendKey(out, fmt, "level", first);
+        if (json)
+          out.append("\"", 1);
+        out.append(stringifyLogLevel(level), 4);
+        if (json)
+          out.append("\"", 1);
+        break;
+      case kTime:
+        appendKey(out, fmt, "time", first);
+        out.template appendFormat<Time::kMaxFormatLen + 2>([&](char *to) {
+          size_t quote = json ? 1 : 0;
+          size_t n = time.formatTo(to + quote, op.fracLen);
+          if (json) {
+            to[0] = '"';
+            to[n + 1] = '"';
+          }
+          return n + 2 * quote;
+        });
+        break;
+      case kThread:
+        appendKey(out, fmt, "tid", first);
+        out.template appendFormat<20>(
+            [tid](char *to) { return formatInt(tid, to); });
+        break;
+      case kFile:
+        if (*loc.file_ == '\0')
+          continue;
+        appendKey(out, fmt, "file", first);
+        appendValue(out, fmt, loc.file_, strlen(loc.file_));
+        break;
+      case kFunction:
+        if (*loc.function_ == '\0')
+          continue;
+        appendKey(out, fmt, "func", first);
+        appendValue(out, fmt, loc.function_, strlen(loc.function_));
+        break;
+      case kLine:
+        if (loc.empty())
+          continue;
+        appendKey(out, fmt, "line", first);
+        out.template appendFormat<10>(
+            [&loc](char *to) { return formatInt(loc.line_, to); });
+        break;
+      default:
+        continue;
+      }
+      first = false;
+    }
+
+    if (!prefix && json)
+      out.append("}", 1);
+    return prefix && !first;
+  }
+
+  /// Append literal text \a data with length \a n , merged into the previous
+  /// text if adjacent and not separated by the message.
+  void appendText(const char *data, size_t n) {
+    if (!ops_.empty() && ops_.back().field == kText &&
+        message_ != ops_.size()) {
+      ops_.back().len += static_cast<uint32_t>(n);
+    } else {
+      ops_.push_back(Op{kText, 0, static_cast<uint32_t>(text_.size()),
+                        static_cast<uint32_t>(n)});
+    }
+    text_.append(data, n);
+  }
+
+  /// Parse the time fraction "{s|ms|us|ns}" at \a pos of \a pattern to
+  /// \a fracLen , return the parsed length.
+  static size_t parseFracLen(const std::string &pattern, size_t pos,
+                             uint8_t *fracLen) {
+    static const struct {
+      const char *name;
+      SecFracLen len;
+    } kFracs[] = {{"{s}", SecFracLen::Sec},
+                  {"{ms}", SecFracLen::Milli},
+                  {"{us}", SecFracLen::Macro},
+                  {"{ns}", SecFracLen::Nano}};
+
+    for (const auto &f : kFracs) {
+      if (pattern.compare(pos, strlen(f.name), f.name) == 0) {
+        *fracLen = f.len;
+        return strlen(f.name);
+      }
+    }
+    return 0;
+  }
+
+  std::vector<Op> ops_;
+  std::string text_;
+  size_t message_; // index of the first op after message.
+};
+
+template <typename Logger> class LimLog {
+public:
+  LimLog()
+      : id_(nextId()), level_(LogLevel::kInfo), flushLevel_(LogLevel::kError),
+        overflow_(kBlock), bufferSize_(BlockingBuffer::kDefaultSize),
+        maxBufferSize_(0), output_(StdoutWriter::write), outputVec_(nullptr),
+        registry_(std::make_shared<LoggerRegistry<Logger>>()),
+        window_(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    kBackendInterval)
+                    .count()),
+        flushing_(false), outputTiming_(false), levelRules_(0), levelGen_(1),
+        format_(kTextFormat), stop_(false) {
+    patterns_.emplace_back(new LogPattern());
+    pattern_ = patterns_.back().get();
+    if (Logger::kAsync)
+      backend_ = std::thread(&LimLog::backendLoop, this);
+  }
+
+  /// Threads logging to it must exit or stop logging before it is destroyed.
+  /// The batched logs of the threads not exited yet are not output, except
+  /// the current thread's.
+  ~LimLog() {
+    if (backend_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(wakeup_.mutex);
+        stop_ = true;
+      }
+      wakeup_.cond.notify_one();
+      backend_.join();
+    }
+
+    // retired loggers are flushed already, and the ones of other threads may
+    // be written meanwhile, so only the logger of current thread is flushed.
+    thread_id_t tid = gettid();
+    registry_->forEachNode([tid](typename LoggerRegistry<Logger>::Node *n) {
+      if (n->active.load(std::memory_order_acquire) &&
+          n->tid.load(std::memory_order_relaxed) == tid)
+        n->logger.flush();
+    });
+  }
+
+  LimLog(const LimLog &) = delete;
+  LimLog &operator=(const LimLog &) = delete;
+
+  /// Produce \a data which length \a n to BlockingBuffer in each thread.
+  void produce(const char *data, size_t n) { logger()->produce(data, n); }
+
+  /// Reserve \a n bytes contiguous space in BlockingBuffer of current thread,
+  /// return nullptr if not available. See BlockingBuffer::reserve().
+  char *reserve(size_t n) { return logger()->reserve(n); }
+
+  /// Commit \a n bytes written to the reserved space.
+  void commit(size_t n) { logger()->commit(n); }
+
+  /// Flush a logline with length \a n .
+  void flush(size_t n) { logger()->flush(n); }
+
+  /// Output the batched logs of current thread, or wake up the background
+  /// thread to output logs of all threads.
+  void flush() {
+    logger()->flush();
+    if (Logger::kAsync) {
+      {
+        std::lock_guard<std::mutex> lock(wakeup_.mutex);
+        flushing_ = true;
+      }
+      wakeup_.cond.notify_one();
+    }
+  }
+
+  /// Set reorder \a window of background thread, logs of all threads are
+  /// merged in time order and held until they are older than the window, so
+  /// the logs completed later within the window are still output in order.
+  /// Flush and destroying LimLog output logs regardless of the window.
+  void setReorderWindow(std::chrono::microseconds window) {
+    window_ = std::chrono::duration_cast<std::chrono::nanoseconds>(window)
+                  .count();
+  }
+
+  /// Set the log level \a level and above to be output immediately.
+  void setFlushLevel(LogLevel level) { flushLevel_ = level; }
+
+  /// Get flush level.
+  LogLevel getFlushLevel() const { return flushLevel_; }
+
+  /// Set flush policy \a policy of batched logs. Like setOutput(), it takes
+  /// effect in current thread and threads logging afterwards.
+  void setFlushPolicy(const FlushPolicy &policy) {
+    policy_ = policy;
+    logger()->setFlushPolicy(policy);
+  }
+
+  /// Set overflow policy \a policy when the buffer is full. Like setOutput(),
+  /// it takes effect in current thread and threads logging afterwards.
+  void setOverflowPolicy(OverflowPolicy policy) {
+    overflow_ = policy;
+    logger()->setOverflowPolicy(policy);
+  }
+
+  /// Set BlockingBuffer \a size of each thread, it grows up to \a maxSize
+  /// under pressure and shrinks back once idle, no growing if \a maxSize is
+  /// not larger. Sizes are rounded up to power of 2. Like setOutput(), it
+  /// takes effect in current thread and threads logging afterwards.
+  void setBufferSize(uint32_t size, uint32_t maxSize = 0) {
+    bufferSize_ = size;
+    maxBufferSize_ = maxSize;
+    logger()->setBufferSize(size, maxSize);
+  }
+
+  /// Set log level \a level.
+  void setLogLevel(LogLevel level) {
+    level_.store(level, std::memory_order_relaxed);
+    levelGen_.fetch_add(1, std::memory_order_release);
+  }
+
+  /// Get log level.
+  LogLevel getLogLevel() const {
+    return level_.load(std::memory_order_relaxed);
+  }
+
+  /// Set log level \a level of the module or file \a pattern, it overrides
+  /// the global log level. A pattern ending with '/' matches the files in the
+  /// directory, e.g. "net/", otherwise it matches the file, e.g. "net/tcp.cc".
+  /// The longest matching pattern takes effect.
+  void setLogLevel(const std::string &pattern, LogLevel level) {
+    std::lock_guard<std::mutex> lock(levelMutex_);
+    auto it = std::find_if(
+        levels_.begin(), levels_.end(),
+        [&](const LevelRule &r) { return r.pattern == pattern; });
+    if (it != levels_.end())
+      it->level = level;
+    else
+      levels_.push_back(LevelRule{pattern, level});
+    levelRules_.store(levels_.size(), std::memory_order_relaxed);
+    levelGen_.fetch_add(1, std::memory_order_release);
+  }
+
+  /// Remove the log level of the module or file \a pattern.
+  void resetLogLevel(const std::string &pattern) {
+    std::lock_guard<std::mutex> lock(levelMutex_);
+    levels_.erase(std::remove_if(levels_.begin(), levels_.end(),
+                                 [&](const LevelRule &r) {
+                                   return r.pattern == pattern;
+                                 }),
+                  levels_.end());
+    levelRules_.store(levels_.size(), std::memory_order_relaxed);
+    levelGen_.fetch_add(1, std::memory_order_release);
+  }
+
+  /// Get log level of source \a file, by the longest matching pattern or the
+  /// global log level.
+  LogLevel getLogLevel(const char *file) {
+    std::lock_guard<std::mutex> lock(levelMutex_);
+    LogLevel level = getLogLevel();
+    size_t matched = 0;
+    for (const LevelRule &r : levels_) {
+      if (r.pattern.size() > matched && matchFile(r.pattern, file)) {
+        level = r.level;
+        matched = r.pattern.size();
+      }
+    }
+    return level;
+  }
+
+  /// Whether log level of any module or file is set.
+  bool hasLogLevelRules() const {
+    return levelRules_.load(std::memory_order_relaxed) != 0;
+  }
+
+  /// Generation of log levels, changed on each setting. LogSite caches its
+  /// log level until the generation changes.
+  uint32_t getLogLevelGeneration() const {
+    return levelGen_.load(std::memory_order_acquire);
+  }
+
+  /// Set layout \a pattern of the text log line, see LogPattern.
+  void setPattern(const std::string &pattern) {
+    // replaced patterns are kept until destroyed, loglines may still use them.
+    std::lock_guard<std::mutex> lock(patternMutex_);
+    patterns_.emplace_back(new LogPattern(pattern));
+    pattern_ = patterns_.back().get();
+  }
+
+  /// Get layout pattern of the text log line.
+  const LogPattern &getPattern() const { return *pattern_; }
+
+  /// Set output format \a format of the text log line.
+  void setFormat(LogFormat format) { format_ = format; }
+
+  /// Get output format of the text log line.
+  LogFormat getFormat() const { return format_; }
+
+  /// Set logger output \a w .
   void setOutput(OutputFunc w) {
     output_ = w;
+    outputVec_ = nullptr;
     logger()->setOutput(w);
   }
 
-private:
+  /// Set vectored logger output \a w , e.g. FdWriter::writev(). The logs in
+  /// several pieces, such as the ones larger than the batch of background
+  /// thread, are output in a call.
+  void setOutput(OutputVecFunc w) {
+    outputVec_ = w;
+    logger()->setOutput(w);
+  }
+
+  /// Measure the time of output calls into stats() if \a timed , it costs
+  /// two clock reads per output. Like setOutput(), it takes effect in current
+  /// thread and threads logging afterwards.
+  void setOutputTiming(bool timed) {
+    outputTiming_ = timed;
+    logger()->setOutputTiming(timed);
+  }
+
+  /// Snapshot of statistics, the sum of loggers of all threads, including the
+  /// exited ones, and of the background thread output. Each logger is added
+  /// to \a loggers if not null. Counters are read while logging, so they may
+  /// be slightly inconsistent with each other. A logger reused by a new
+  /// thread keeps counting from the exited one.
+  LogStats stats(std::vector<LogStats> *loggers = nullptr) {
+    LogStats total = backendStats_.load();
+    registry_->forEachNode(
+        [&total, loggers](typename LoggerRegistry<Logger>::Node *n) {
+          LogStats s = n->logger.stats();
+          if (n->active.load(std::memory_order_relaxed))
+            s.tid = n->tid.load(std::memory_order_relaxed);
+          total += s;
+          if (loggers)
+            loggers->push_back(s);
+        });
+    return total;
+  }
+
+  /// Logger of current thread, created or reused from the exited threads at
+  /// the first time, and retired when the thread exits.
+  /// A thread holds one logger, so logging to another LimLog of the same
+  /// Logger type retires the logger of previous one.
   Logger *logger() {
-    static thread_local Logger *l = nullptr;
-    if (!l) {
-      std::lock_guard<std::mutex> lock(loggerMutex_);
-      l = static_cast<Logger *>(new Logger);
+    static thread_local ThreadLogger t_logger;
+    if (t_logger.id != id_) {
+      t_logger.retire();
+
+      typename LoggerRegistry<Logger>::Node *n = registry_->acquire();
+      Logger *l = &n->logger;
+      n->tid.store(gettid(), std::memory_order_relaxed);
       l->setOutput(output_);
-      loggers_.push_back(l);
+      if (OutputVecFunc v = outputVec_.load())
+        l->setOutput(v);
+      l->setOutputTiming(outputTiming_);
+      l->setFlushPolicy(policy_);
+      l->setWakeup(&wakeup_);
+      l->setOverflowPolicy(overflow_);
+      l->setBufferSize(bufferSize_, maxBufferSize_);
+
+      t_logger.id = id_;
+      t_logger.logger = l;
+      t_logger.node = n;
+      t_logger.registry = registry_;
     }
-    return l;
+    return t_logger.logger;
   }
 
-  LogLevel level_;
-  OutputFunc output_;
-  std::mutex loggerMutex_;
-  std::vector<Logger *> loggers_;
+private:
+  /// Thread exit guard, retire the logger of current thread.
+  struct ThreadLogger {
+    ThreadLogger() : id(0), logger(nullptr), node(nullptr) {}
+    ~ThreadLogger() { retire(); }
+
+    void retire() {
+      std::shared_ptr<LoggerRegistry<Logger>> r = registry.lock();
+      if (r)
+        r->retire(node);
+      id = 0;
+      logger = nullptr;
+      node = nullptr;
+      registry.reset();
+    }
+
+    uint64_t id; // id of LimLog the logger belongs to.
+    Logger *logger;
+    typename LoggerRegistry<Logger>::Node *node;
+    std::weak_ptr<LoggerRegistry<Logger>> registry;
+  };
+
+  /// Unique id of LimLog, never reused even the address is.
+  static uint64_t nextId() {
+    static std::atomic<uint64_t> s_id(0);
+    return ++s_id;
+  }
+
+  /// Background thread, consume the complete logs of all threads in batch
+  /// until LimLog is destroyed.
+  void backendLoop() {
+    std::unique_ptr<char[]> batch(new char[kBatchSize]);
+
+    for (;;) {
+      bool stop = stop_.load();
+      bool flushing = flushing_.exchange(false);
+
+      // Keep draining while there are logs, so the last logs are not lost
+      // when LimLog is destroyed.
+      if (drain(batch.get(), stop || flushing) != 0)
+        continue;
+
+      if (stop)
+        break;
+
+      // logs held in the reorder window are checked again soon.
+      std::unique_lock<std::mutex> lock(wakeup_.mutex);
+      if (!heads_.empty()) {
+        if (!stop_ && !flushing_)
+          wakeup_.cond.wait_for(lock, kBackendInterval);
+        continue;
+      }
+
+      // all loggers are empty, sleep until a log is complete. Check again
+      // after marking idle for the logs completed before it is seen.
+      wakeup_.idle.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      lock.unlock();
+      if (drain(batch.get(), false) != 0 || !heads_.empty()) {
+        wakeup_.idle.store(false, std::memory_order_relaxed);
+        continue;
+      }
+
+      lock.lock();
+      wakeup_.cond.wait(lock, [this] {
+        return !wakeup_.idle.load(std::memory_order_relaxed) || stop_ ||
+               flushing_;
+      });
+      wakeup_.idle.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  /// The first complete log of a logger.
+  struct LogHead {
+    int64_t time;
+    uint32_t len;
+    Logger *logger;
+
+    bool operator>(const LogHead &rhs) const { return time > rhs.time; }
+  };
+
+  /// Consume complete logs of all loggers to \a batch in time order by
+  /// k-way merge, output once the batch is full. Logs within the reorder
+  /// window are held unless \a all . Return the consumed bytes.
+  /// The logs larger than batch are consumed alone, and output with the
+  /// batch as segments in order.
+  size_t drain(char *batch, bool all) {
+    size_t total = 0;
+    uint32_t len = 0;   // used bytes of batch.
+    uint32_t start = 0; // start of batch not in segments_.
+    int64_t deadline = all ? std::numeric_limits<int64_t>::max()
+                           : Time::now().count() - window_.load();
+
+    // min-heap on time of the first log of each logger.
+    heads_.clear();
+    registry_->forEach([this](Logger *l) {
+      LogHead h;
+      h.logger = l;
+      if (l->front(&h.time, &h.len))
+        heads_.push_back(h);
+    });
+    std::make_heap(heads_.begin(), heads_.end(), std::greater<LogHead>());
+
+    while (!heads_.empty() && heads_.front().time <= deadline) {
+      std::pop_heap(heads_.begin(), heads_.end(), std::greater<LogHead>());
+      LogHead &h = heads_.back();
+
+      if (h.len <= kBatchSize) {
+        if (h.len > kBatchSize - len) {
+          addSegment(batch + start, len - start);
+          outputSegments();
+          len = start = 0;
+        }
+
+        if (h.logger->consume(batch + len, h.len)) {
+          len += h.len;
+          total += h.len;
+        }
+      } else {
+        std::unique_ptr<char[]> large(new char[h.len]);
+        if (h.logger->consume(large.get(), h.len)) {
+          addSegment(batch + start, len - start);
+          start = len;
+          addSegment(large.get(), h.len);
+          larges_.push_back(std::move(large));
+          total += h.len;
+          if (segments_.size() >= kMaxSegments)
+            outputSegments();
+        }
+      }
+
+      if (h.logger->front(&h.time, &h.len))
+        std::push_heap(heads_.begin(), heads_.end(), std::greater<LogHead>());
+      else
+        heads_.pop_back();
+    }
+
+    addSegment(batch + start, len - start);
+    outputSegments();
+    return total;
+  }
+
+  /// Add \a n bytes \a data to the segments to output, skip if empty.
+  void addSegment(char *data, size_t n) {
+    if (n != 0)
+      segments_.push_back({data, n});
+  }
+
+  /// Output the segments in background thread, in a call if the output is
+  /// vectored.
+  void outputSegments() {
+    if (segments_.empty())
+      return;
+    backendStats_.output(output_.load(), outputVec_.load(), segments_.data(),
+                         static_cast<int>(segments_.size()),
+                         outputTiming_.load(std::memory_order_relaxed));
+    segments_.clear();
+    larges_.clear();
+  }
+
+  struct LevelRule {
+    std::string pattern;
+    LogLevel level;
+  };
+
+  /// Whether \a file is in the directory or is the file \a pattern .
+  static bool matchFile(const std::string &pattern, const char *file) {
+    size_t fileLen = strlen(file);
+    size_t n = pattern.size();
+    if (n == 0 || n > fileLen)
+      return false;
+
+    // directory, match at the beginning or after a '/'.
+    if (pattern.back() == '/') {
+      for (const char *p = file; (p = strstr(p, pattern.c_str())) != nullptr;
+           ++p) {
+        if (p == file || p[-1] == '/')
+          return true;
+      }
+      return false;
+    }
+
+    // file, match at the end and start at the beginning or after a '/'.
+    const char *p = file + fileLen - n;
+    return memcmp(p, pattern.data(), n) == 0 && (p == file || p[-1] == '/');
+  }
+
+  static constexpr uint32_t kBatchSize = 1024 * 1024 * 4; // 4 MB
+  static constexpr size_t kMaxSegments = 64;
+  static constexpr std::chrono::milliseconds kBackendInterval{1};
+
+  const uint64_t id_;
+  std::atomic<LogLevel> level_;
+  LogLevel flushLevel_;
+  FlushPolicy policy_;
+  OverflowPolicy overflow_;
+  uint32_t bufferSize_;
+  uint32_t maxBufferSize_;
+  std::atomic<OutputFunc> output_;
+  std::atomic<OutputVecFunc> outputVec_; // used instead of output_ if set.
+  std::shared_ptr<LoggerRegistry<Logger>> registry_;
+
+  std::atomic<int64_t> window_; // reorder window in nanoseconds.
+  std::atomic<bool> flushing_;
+  std::vector<LogHead> heads_; // used by background thread.
+  std::vector<struct iovec> segments_;           // used by background thread.
+  std::vector<std::unique_ptr<char[]>> larges_; // logs larger than batch.
+  std::atomic<bool> outputTiming_;
+  StatCounters backendStats_; // output of background thread.
+
+  std::mutex levelMutex_;
+  std::vector<LevelRule> levels_;
+  std::atomic<size_t> levelRules_; // size of levels_, read without lock.
+  std::atomic<uint32_t> levelGen_;
+
+  std::mutex patternMutex_;
+  std::vector<std::unique_ptr<LogPattern>> patterns_;
+  std::atomic<const LogPattern *> pattern_;
+  std::atomic<LogFormat> format_;
+
+  std::atomic<bool> stop_;
+  BackendWakeup wakeup_;
+  std::thread backend_;
+};
+
+template <typename Logger>
+constexpr std::chrono::milliseconds LimLog<Logger>::kBackendInterval;
+
+#ifdef LIMLOG_ASYNC
+using DefaultLogger = AsyncLogger;
+#else
+using DefaultLogger = SyncLogger;
+#endif
+
+/// Singleton pointer.
+/// Define LIMLOG_ASYNC before including limlog.h to output logs in the
+/// background thread.
+inline LimLog<DefaultLogger> *singleton() {
+  static LimLog<DefaultLogger> s_limlog;
+  return &s_limlog;
+}
+
+/// Float number formatted with fixed precision, e.g.
+///   LOG_INFO << limlog::fixed(3.14159, 2); // 3.14
+struct FixedFloat {
+  double value;
+  int precision;
+};
+
+/// Format \a v with \a precision digits after the decimal point.
+inline FixedFloat fixed(double v, int precision) {
+  return FixedFloat{v, precision};
+}
+
+/// Max width of HexInt and WidthInt.
+static constexpr int kMaxWidth = 64;
+
+/// Integer formatted in lowercase hexadecimal, e.g.
+///   LOG_INFO << limlog::hex(255);    // ff
+///   LOG_INFO << limlog::hex(255, 4); // 00ff
+///   LOG_INFO << limlog::hex(-1);     // ffffffff
+struct HexInt {
+  uint64_t value;
+  int width;
+
+  /// Format to \a to which has kMaxWidth bytes at least.
+  size_t formatTo(char *to) const { return formatHex(value, to, width); }
+};
+
+/// Format \a v in hexadecimal, padded with leading zeros to \a width digits.
+/// Negative value is in two's complement of its type.
+template <typename T,
+          typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
+inline HexInt hex(T v, int width = 0) {
+  typedef typename std::make_unsigned<T>::type U;
+  return HexInt{static_cast<U>(v), std::min(std::max(width, 0), kMaxWidth)};
+}
+
+/// Integer right aligned in a fixed width, e.g.
+///   LOG_INFO << limlog::width(42, 5);       // 00042
+///   LOG_INFO << limlog::width(-42, 5, ' '); //   -42
+struct WidthInt {
+  uint64_t abs;
+  bool negative;
+  int width;
+  char fill;
+
+  /// Format to \a to which has kMaxWidth bytes at least.
+  size_t formatTo(char *to) const {
+    size_t digits = countDigits(abs);
+    size_t len = digits + negative;
+    size_t pad = static_cast<size_t>(width) > len ? width - len : 0;
+
+    // zeros are after the sign.
+    char *p = to;
+    if (fill != '0') {
+      memset(p, fill, pad);
+      p += pad;
+    }
+    if (negative)
+      *p++ = '-';
+    p += formatUIntWidth(abs, p, fill == '0' ? digits + pad : digits);
+    return p - to;
+  }
+};
+
+/// Format \a v right aligned in \a n characters, padded with \a fill .
+template <typename T,
+          typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
+inline WidthInt width(T v, int n, char fill = '0') {
+  typedef typename std::make_unsigned<T>::type U;
+  U u = static_cast<U>(v);
+  bool negative = v < 0;
+  if (negative)
+    u = static_cast<U>(0 - u);
+  return WidthInt{u, negative, std::min(std::max(n, 0), kMaxWidth), fill};
+}
+
+/// Format pointer \a p as '0x' and hexadecimal to \a to , which has 18 bytes
+/// at least. Return the length.
+inline size_t formatPointer(const void *p, char *to) {
+  to[0] = '0';
+  to[1] = 'x';
+  return 2 + formatHex(reinterpret_cast<uintptr_t>(p), to + 2);
+}
+
+/// Max length of formatted pointer.
+static constexpr size_t kMaxPointerLen = 18;
+
+/// Bytes of a string not terminated by NUL, logged without copying to
+/// std::string, e.g.
+///   LOG_INFO << limlog::span(buf, len);
+struct StringSpan {
+  const char *data;
+  size_t size;
+};
+
+/// Span of \a n bytes \a data .
+inline StringSpan span(const char *data, size_t n) {
+  return StringSpan{data, n};
+}
+
+/// Span of string \a s which has data() and size(), e.g. std::string_view.
+template <typename S> inline StringSpan span(const S &s) {
+  return StringSpan{s.data(), s.size()};
+}
+
+/// Static information of a log statement, a unique id is allocated when it is
+/// first executed. The log level of the site is cached, and looked up again
+/// once log levels are changed.
+struct LogSite {
+  explicit LogSite(const LogLoc &loc)
+      : id_(nextId()), loc_(loc), level_(kTrace), levelGen_(0) {}
+
+  LogSite(const LogSite &) = delete;
+  LogSite &operator=(const LogSite &) = delete;
+
+  static uint32_t nextId() {
+    static std::atomic<uint32_t> s_id(0);
+    return s_id++;
+  }
+
+  /// Whether the log of \a level is enabled at the site.
+  bool enabled(LogLevel level) {
+    uint32_t gen = singleton()->getLogLevelGeneration();
+    if (levelGen_.load(std::memory_order_acquire) != gen) {
+      level_.store(singleton()->getLogLevel(loc_.file_),
+                   std::memory_order_relaxed);
+      levelGen_.store(gen, std::memory_order_release);
+    }
+    return level >= level_.load(std::memory_order_relaxed);
+  }
+
+  /// This site if the log of \a level is enabled, otherwise nullptr.
+  LogSite *check(LogLevel level) { return enabled(level) ? this : nullptr; }
+
+  uint32_t id_;
+  LogLoc loc_;
+
+private:
+  std::atomic<LogLevel> level_;
+  std::atomic<uint32_t> levelGen_;
 };
 
-/// Singleton pointer.
-inline LimLog<SyncLogger> *singleton() {
-  static LimLog<SyncLogger> s_limlog;
-  return &s_limlog;
-}
+/// Sites of the locations given at run time, in an open addressing hash table
+/// of kMaxSites slots. A site is inserted by CAS and never removed, so the
+/// lookup is lock-free. The locations out of the table share a site without
+/// location, only the global log level applies to them and their binary logs
+/// have no location.
+class RuntimeSites {
+public:
+  /// Site of the location \a loc , shared by the logs with the same location,
+  /// or nullptr if the log of \a level is disabled. The global log level is
+  /// checked first, the site is looked up only if it is enabled or any log
+  /// level of module is set.
+  static LogSite *find(LogLevel level, const LogLoc &loc) {
+    if (!singleton()->hasLogLevelRules() && level < singleton()->getLogLevel())
+      return nullptr;
+
+    LogSite *site = lookup(loc);
+    return site->enabled(level) ? site : nullptr;
+  }
+
+private:
+  /// Site of the location \a loc , inserted if absent.
+  static LogSite *lookup(const LogLoc &loc) {
+    static std::atomic<Site *> s_sites[kMaxSites];
+    static LogSite s_unknown{LogLoc()};
+
+    size_t h = hash(loc);
+    Site *created = nullptr;
+    for (size_t i = 0; i < kMaxProbes; ++i) {
+      std::atomic<Site *> &slot = s_sites[(h + i) % kMaxSites];
+      Site *s = slot.load(std::memory_order_acquire);
+      if (!s) {
+        if (!created)
+          created = new Site(loc);
+        if (slot.compare_exchange_strong(s, created,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire))
+          return &created->site;
+      }
+      if (s->matches(loc)) {
+        delete created;
+        return &s->site;
+      }
+    }
+
+    delete created;
+    return &s_unknown;
+  }
+
+  /// Site owning a copy of the location.
+  struct Site {
+    explicit Site(const LogLoc &loc)
+        : file(loc.file_), function(loc.function_),
+          site(LogLoc(file.c_str(), function.c_str(), loc.line_)) {}
+
+    bool matches(const LogLoc &loc) const {
+      return site.loc_.line_ == loc.line_ && file == loc.file_ &&
+             function == loc.function_;
+    }
+
+    const std::string file;
+    const std::string function;
+    LogSite site;
+  };
+
+  /// FNV-1a hash of location \a loc .
+  static size_t hash(const LogLoc &loc) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const char *p : {loc.file_, loc.function_})
+      for (; *p; ++p)
+        h = (h ^ static_cast<unsigned char>(*p)) * 1099511628211ULL;
+    return static_cast<size_t>((h ^ loc.line_) * 1099511628211ULL);
+  }
+
+  static const size_t kMaxSites = 4096;
+  static const size_t kMaxProbes = 16;
+};
+
+/// Append bytes of a log line to the logger of current thread, and complete
+/// the log line when destroyed.
+class LogAppender {
+protected:
+  explicit LogAppender(LogLevel level)
+      : logger_(singleton()->logger()), time_(Time::now()), count_(0),
+        level_(level) {
+    logger_->begin(time_.count());
+  }
+
+  ~LogAppender() {
+    logger_->flush(count_);
+    if (level_ >= singleton()->getFlushLevel())
+      singleton()->flush();
+  }
 
-/// Log Location, include file, function, line.
-struct LogLoc {
-public:
-  LogLoc() : LogLoc("", "", 0) {}
+  void append(const char *data, size_t n) {
+    logger_->produce(data, n);
+    count_ += n;
+  }
 
-  LogLoc(const char *file, const char *function, uint32_t line)
-      : file_(file), function_(function), line_(line) {}
+  void append(const char *data) { append(data, strlen(data)); }
 
-  bool empty() const { return line_ == 0; }
+  /// Format at most \a N bytes by \a format directly into the reserved space
+  /// of buffer, fall back to a temporary when the space is not contiguous.
+  template <size_t N, typename Format> void appendFormat(Format format) {
+    char *p = logger_->reserve(N);
+    if (p) {
+      size_t n = format(p);
+      logger_->commit(n);
+      count_ += n;
+    } else {
+      char buf[N];
+      append(buf, format(buf));
+    }
+  }
 
-  const char *file_;
-  const char *function_;
-  uint32_t line_;
+  friend class LogPattern;
+
+  // logger of current thread resolved once, to avoid looking up the singleton
+  // and thread local storage for each append.
+  DefaultLogger *logger_;
+  Time time_;
+  size_t count_; // count of a log line bytes.
+  LogLevel level_;
 };
 
 /// A line log info, usage is same as 'std::cout'.
@@ -563,71 +4423,116 @@ public:
 //  +-------+------+-----------+------+------+------------+------+
 //  | level | time | thread id | logs | file | (function) | line |
 //  +-------+------+-----------+------+------+------------+------+
-class LogLine {
+class LogLine : public LogAppender {
 public:
   LogLine() = delete;
   LogLine(const LogLine &) = delete;
   LogLine &operator=(const LogLine &) = delete;
 
-  LogLine(LogLevel level, const LogLoc &loc) : count_(0), loc_(loc) {
-    *this << stringifyLogLevel(level) << ' ' << Time::now().formatMilli() << ' '
-          << gettid() << loc_ << ' ';
+  LogLine(LogLevel level, const LogLoc &loc)
+      : LogAppender(level), loc_(loc), pattern_(singleton()->getPattern()),
+        format_(singleton()->getFormat()), message_(kNotStarted) {
+    first_ = !pattern_.format(*this, true, format_, level_, time_, gettid(),
+                              loc_);
   }
 
   ~LogLine() {
+    if (format_ != kTextFormat && message_ == kNotStarted)
+      openMessage();
+    closeMessage();
+    pattern_.format(*this, false, format_, level_, time_, gettid(), loc_);
     *this << '\n';
-    singleton()->flush(count_);
   }
 
   /// Overloaded `operator<<` for type various of integral num.
   template <typename T,
             typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
   LogLine &operator<<(T v) {
-    char buf[sizeof(T) * 4];
-    size_t len = formatInt(v, buf);
-    append(buf, len);
+    openMessage();
+    put(v);
     return *this;
   }
 
   /// Overloaded `operator<<` for type various of bool.
   LogLine &operator<<(bool v) {
-    if (v)
-      append("true", 4);
-    else
-      append("false", 5);
+    openMessage();
+    put(v);
     return *this;
   }
 
   /// Overloaded `operator<<` for type various of char.
   LogLine &operator<<(char v) {
-    append(&v, 1);
+    // the line ending is not part of message.
+    if (v == '\n' && message_ != kStarted) {
+      append(&v, 1);
+      return *this;
+    }
+    openMessage();
+    putString(&v, 1);
     return *this;
   }
 
   /// Overloaded `operator<<` for type various of float num.
   LogLine &operator<<(float v) {
-    std::numeric_limits<float>::min();
-    std::string s = std::to_string(v);
-    append(s.data(), s.length());
+    openMessage();
+    put(v);
     return *this;
   }
 
   /// Overloaded `operator<<` for type various of float num.
   LogLine &operator<<(double v) {
-    std::string s = std::to_string(v);
-    append(s.data(), s.length());
+    openMessage();
+    put(v);
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for float num with fixed precision.
+  LogLine &operator<<(const FixedFloat &v) {
+    openMessage();
+    put(v);
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for integer in hexadecimal.
+  LogLine &operator<<(const HexInt &v) {
+    openMessage();
+    putFormatted<kMaxWidth>([&v](char *to) { return v.formatTo(to); });
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for integer in fixed width.
+  LogLine &operator<<(const WidthInt &v) {
+    openMessage();
+    putFormatted<kMaxWidth>([&v](char *to) { return v.formatTo(to); });
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for pointer.
+  LogLine &operator<<(const void *v) {
+    openMessage();
+    putFormatted<kMaxPointerLen>(
+        [v](char *to) { return formatPointer(v, to); });
     return *this;
   }
 
   /// Overloaded `operator<<` for type various of char*.
   LogLine &operator<<(const char *v) {
-    append(v);
+    openMessage();
+    putString(v, strlen(v));
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for string span.
+  LogLine &operator<<(const StringSpan &v) {
+    openMessage();
+    putString(v.data, v.size);
     return *this;
   }
 
   /// Overloaded `operator<<` for type various of std::string.
   LogLine &operator<<(const std::string &v) {
-    append(v.data(), v.length());
+    openMessage();
+    putString(v.data(), v.length());
     return *this;
   }
 
@@ -637,27 +4542,788 @@ public:
     return *this;
   }
 
+  /// Append a field with \a key and value \a v , e.g.
+  ///   LOG_INFO.kv("user", 42) << "login";
+  /// outputs 'user=42 login' in text, '"user":42,"msg":"login"' in JSON and
+  /// 'user=42 msg="login"' in logfmt, see LogFormat. Strings are quoted and
+  /// escaped in JSON and logfmt, the key is not escaped. The message appended
+  /// after a field is started again with another 'msg' key.
+  template <typename T> LogLine &kv(const char *key, const T &v) {
+    closeMessage();
+    appendKey(*this, format_, key, first_);
+    first_ = false;
+    putField(v);
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for field, see kv().
+  template <typename T> LogLine &operator<<(const KeyValue<T> &v) {
+    return kv(v.key, v.value);
+  }
+
 private:
-  void append(const char *data, size_t n) {
-    singleton()->produce(data, n);
-    count_ += n;
+  template <typename Out>
+  friend void appendKey(Out &out, LogFormat format, const char *key,
+                        bool first);
+  template <typename Out>
+  friend void appendValue(Out &out, LogFormat format, const char *data,
+                          size_t n);
+  template <typename Out>
+  friend void appendEscaped(Out &out, const char *data, size_t n);
+
+  enum MessageState : uint8_t { kNotStarted, kStarted, kClosed };
+
+  /// Start the message, quoted with key 'msg' in JSON and logfmt, separated
+  /// by space from the former field in text.
+  void openMessage() {
+    if (message_ == kStarted)
+      return;
+
+    if (format_ != kTextFormat) {
+      appendKey(*this, format_, "msg", first_);
+      append("\"", 1);
+    } else if (!first_) {
+      append(" ", 1);
+    }
+    message_ = kStarted;
+    first_ = false;
   }
 
-  void append(const char *data) { append(data, strlen(data)); }
+  /// Close the message before a field.
+  void closeMessage() {
+    if (message_ != kStarted)
+      return;
+
+    if (format_ != kTextFormat)
+      append("\"", 1);
+    message_ = kClosed;
+  }
+
+  template <typename T,
+            typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
+  void put(T v) {
+    appendFormat<sizeof(T) * 4>([v](char *to) { return formatInt(v, to); });
+  }
+
+  void put(bool v) {
+    if (v)
+      append("true", 4);
+    else
+      append("false", 5);
+  }
+
+  void put(float v) {
+    appendFormat<kMaxFloatLen>([v](char *to) { return formatFloat(v, to); });
+  }
+
+  void put(double v) {
+    appendFormat<kMaxFloatLen>([v](char *to) { return formatFloat(v, to); });
+  }
+
+  void put(const FixedFloat &v) {
+    appendFormat<kMaxFloatLen>([&v](char *to) {
+      return formatFloatFixed(v.value, to, v.precision);
+    });
+  }
+
+  /// Append string \a data with length \a n , escaped unless in text.
+  void putString(const char *data, size_t n) {
+    if (format_ == kTextFormat)
+      append(data, n);
+    else
+      appendEscaped(*this, data, n);
+  }
+
+  /// Append at most \a N bytes formatted by \a format , see putString().
+  template <size_t N, typename Format> void putFormatted(Format format) {
+    if (format_ == kTextFormat) {
+      appendFormat<N>(format);
+    } else {
+      char buf[N];
+      appendEscaped(*this, buf, format(buf));
+    }
+  }
+
+  /// Append at most \a N bytes string value formatted by \a format .
+  template <size_t N, typename Format> void putFormattedField(Format format) {
+    char buf[N];
+    appendValue(*this, format_, buf, format(buf));
+  }
+
+  template <typename T,
+            typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
+  void putField(T v) {
+    put(v);
+  }
+
+  void putField(bool v) { put(v); }
+
+  void putField(char v) { appendValue(*this, format_, &v, 1); }
+
+  void putField(const char *v) { appendValue(*this, format_, v, strlen(v)); }
+
+  void putField(const std::string &v) {
+    appendValue(*this, format_, v.data(), v.length());
+  }
+
+  void putField(const StringSpan &v) {
+    appendValue(*this, format_, v.data, v.size);
+  }
+
+  // not numbers in JSON, they are quoted as strings.
+  void putField(const HexInt &v) {
+    putFormattedField<kMaxWidth>([&v](char *to) { return v.formatTo(to); });
+  }
+
+  void putField(const WidthInt &v) {
+    putFormattedField<kMaxWidth>([&v](char *to) { return v.formatTo(to); });
+  }
+
+  void putField(const void *v) {
+    putFormattedField<kMaxPointerLen>(
+        [v](char *to) { return formatPointer(v, to); });
+  }
+
+  // NaN and infinity are not numbers in JSON.
+  void putField(float v) { putField(static_cast<double>(v)); }
+
+  void putField(double v) {
+    if (format_ == kJsonFormat && !std::isfinite(v))
+      append("null", 4);
+    else
+      put(v);
+  }
+
+  void putField(const FixedFloat &v) {
+    if (format_ == kJsonFormat && !std::isfinite(v.value))
+      append("null", 4);
+    else
+      put(v);
+  }
 
-  size_t count_; // count of a log line bytes.
   LogLoc loc_;
+  const LogPattern &pattern_;
+  LogFormat format_;
+  MessageState message_;
+  bool first_; // no field or message is output after the prefix yet.
+};
+
+/// Tags of binary log records and arguments.
+enum BinaryTag : uint8_t {
+  kTagEnd,      // end of log record.
+  kTagSite,     // site record: id, line, file.
+  kTagLog,      // log record: site id, level, time, thread id, args, end.
+  kTagSigned,   // zigzag varint.
+  kTagUnsigned, // varint.
+  kTagTrue,
+  kTagFalse,
+  kTagChar,   // 1 byte.
+  kTagFloat,  // 4 bytes.
+  kTagDouble, // 8 bytes.
+  kTagString, // varint length and bytes.
+  kTagFixed,  // 8 bytes double and 1 byte precision.
+  kTagKey,    // varint length and bytes of field key, followed by the value.
+};
+
+/// Encode \a v as LEB128 varint to \a to (10 bytes at most).
+inline size_t encodeVarint(uint64_t v, char *to) {
+  char *p = to;
+  while (v >= 0x80) {
+    *p++ = static_cast<char>(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = static_cast<char>(v);
+  return p - to;
+}
+
+/// Decode varint from [\a p, \a end) to \a v , return 0 if incomplete.
+inline size_t decodeVarint(const char *p, const char *end, uint64_t *v) {
+  uint64_t r = 0;
+  for (size_t i = 0; i < 10 && p + i < end; ++i) {
+    uint8_t b = static_cast<uint8_t>(p[i]);
+    r |= static_cast<uint64_t>(b & 0x7F) << (7 * i);
+    if (!(b & 0x80)) {
+      *v = r;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+/// A line log in binary, the arguments are copied raw and formatting is
+/// deferred to BinaryDecoder, in the background thread or offline.
+// Log format in memory.
+//  +--------+---------+-------+------+-----------+------+-----+
+//  | kTagLog| site id | level | time | thread id | args | end |
+//  +--------+---------+-------+------+-----------+------+-----+
+// A site record with the file and line precedes the first log of the site in
+// each thread.
+class BinaryLogLine : public LogAppender {
+public:
+  BinaryLogLine() = delete;
+  BinaryLogLine(const BinaryLogLine &) = delete;
+  BinaryLogLine &operator=(const BinaryLogLine &) = delete;
+
+  BinaryLogLine(LogLevel level, const LogSite &site) : LogAppender(level) {
+    static thread_local std::vector<bool> t_defined;
+    static thread_local uint64_t t_lost = 0;
+
+    // define the sites again once logs are lost, they may hold definitions.
+    uint64_t lost = logger_->dropped() + logger_->discarded();
+    if (lost != t_lost) {
+      t_defined.assign(t_defined.size(), false);
+      t_lost = lost;
+    }
+
+    if (site.id_ >= t_defined.size())
+      t_defined.resize(site.id_ + 1);
+    if (!t_defined[site.id_]) {
+      appendSite(site);
+      t_defined[site.id_] = true;
+    }
+
+    int64_t now = time_.count();
+    thread_id_t tid = gettid();
+    appendFormat<32>([&](char *to) {
+      char *p = to;
+      *p++ = kTagLog;
+      p += encodeVarint(site.id_, p);
+      *p++ = static_cast<char>(level);
+      memcpy(p, &now, sizeof(now));
+      p += sizeof(now);
+      p += encodeVarint(static_cast<uint64_t>(tid), p);
+      return p - to;
+    });
+  }
+
+  ~BinaryLogLine() { appendTag(kTagEnd); }
+
+  /// Overloaded `operator<<` for type various of integral num.
+  template <typename T,
+            typename std::enable_if<std::is_integral<T>::value, T>::type = 0>
+  BinaryLogLine &operator<<(T v) {
+    appendFormat<11>([v](char *to) {
+      if (std::is_signed<T>::value) {
+        int64_t s = static_cast<int64_t>(v);
+        *to = kTagSigned;
+        return 1 + encodeVarint((static_cast<uint64_t>(s) << 1) ^
+                                    static_cast<uint64_t>(s >> 63),
+                                to + 1);
+      }
+      *to = kTagUnsigned;
+      return 1 + encodeVarint(static_cast<uint64_t>(v), to + 1);
+    });
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for type various of bool.
+  BinaryLogLine &operator<<(bool v) {
+    appendTag(v ? kTagTrue : kTagFalse);
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for type various of char.
+  BinaryLogLine &operator<<(char v) {
+    appendRaw(kTagChar, v);
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for type various of float num.
+  BinaryLogLine &operator<<(float v) {
+    appendRaw(kTagFloat, v);
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for type various of float num.
+  BinaryLogLine &operator<<(double v) {
+    appendRaw(kTagDouble, v);
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for float num with fixed precision.
+  BinaryLogLine &operator<<(const FixedFloat &v) {
+    appendFormat<1 + sizeof(double) + 1>([&v](char *to) {
+      *to = kTagFixed;
+      memcpy(to + 1, &v.value, sizeof(v.value));
+      to[1 + sizeof(double)] = static_cast<char>(v.precision);
+      return 1 + sizeof(double) + 1;
+    });
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for type various of char*.
+  BinaryLogLine &operator<<(const char *v) {
+    appendString(v, strlen(v));
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for type various of std::string.
+  BinaryLogLine &operator<<(const std::string &v) {
+    appendString(v.data(), v.length());
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for string span.
+  BinaryLogLine &operator<<(const StringSpan &v) {
+    appendString(v.data, v.size);
+    return *this;
+  }
+
+  // hexadecimal, fixed width and pointer are formatted as strings, they are
+  // cheap and keep the decoder simple.
+
+  /// Overloaded `operator<<` for integer in hexadecimal.
+  BinaryLogLine &operator<<(const HexInt &v) {
+    char buf[kMaxWidth];
+    appendString(buf, v.formatTo(buf));
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for integer in fixed width.
+  BinaryLogLine &operator<<(const WidthInt &v) {
+    char buf[kMaxWidth];
+    appendString(buf, v.formatTo(buf));
+    return *this;
+  }
+
+  /// Overloaded `operator<<` for pointer.
+  BinaryLogLine &operator<<(const void *v) {
+    char buf[kMaxPointerLen];
+    appendString(buf, formatPointer(v, buf));
+    return *this;
+  }
+
+  /// Append a field with \a key and value \a v , see LogLine::kv().
+  template <typename T> BinaryLogLine &kv(const char *key, const T &v) {
+    size_t n = strlen(key);
+    appendFormat<11>([n](char *to) {
+      *to = kTagKey;
+      return 1 + encodeVarint(n, to + 1);
+    });
+    append(key, n);
+    return *this << v;
+  }
+
+  /// Overloaded `operator<<` for field, see kv().
+  template <typename T> BinaryLogLine &operator<<(const KeyValue<T> &v) {
+    return kv(v.key, v.value);
+  }
+
+private:
+  void appendTag(BinaryTag tag) {
+    char t = tag;
+    append(&t, 1);
+  }
+
+  template <typename T> void appendRaw(BinaryTag tag, T v) {
+    appendFormat<1 + sizeof(T)>([tag, v](char *to) {
+      *to = tag;
+      memcpy(to + 1, &v, sizeof(v));
+      return 1 + sizeof(v);
+    });
+  }
+
+  void appendString(const char *data, size_t n) {
+    appendFormat<11>([n](char *to) {
+      *to = kTagString;
+      return 1 + encodeVarint(n, to + 1);
+    });
+    append(data, n);
+  }
+
+  void appendSite(const LogSite &site) {
+    size_t fileLen = strlen(site.loc_.file_);
+    appendFormat<32>([&](char *to) {
+      char *p = to;
+      *p++ = kTagSite;
+      p += encodeVarint(site.id_, p);
+      p += encodeVarint(site.loc_.line_, p);
+      p += encodeVarint(fileLen, p);
+      return p - to;
+    });
+    append(site.loc_.file_, fileLen);
+  }
+};
+
+/// Decode binary logs of BinaryLogLine to text in the same format as LogLine.
+/// Data can be fed in arbitrary pieces, the incomplete record at the end is
+/// kept until the rest is fed.
+/// e.g. decode in the background thread:
+///   limlog::BinaryDecoder::instance().setOutput(limlog::StdoutWriter::write);
+///   limlog::singleton()->setOutput(limlog::BinaryDecoder::write);
+class BinaryDecoder {
+public:
+  BinaryDecoder()
+      : output_(StdoutWriter::write), format_(kTextFormat), out_{text_} {}
+
+  BinaryDecoder(const BinaryDecoder &) = delete;
+  BinaryDecoder &operator=(const BinaryDecoder &) = delete;
+
+  /// Decoder used by write().
+  static BinaryDecoder &instance() {
+    static BinaryDecoder s_decoder;
+    return s_decoder;
+  }
+
+  /// OutputFunc decoding with instance().
+  static ssize_t write(const char *data, size_t n) {
+    return instance().decode(data, n);
+  }
+
+  /// Set output \a w of decoded text.
+  void setOutput(OutputFunc w) { output_ = w; }
+
+  /// Set layout \a pattern of decoded text, see LogPattern.
+  void setPattern(const std::string &pattern) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pattern_ = LogPattern(pattern);
+  }
+
+  /// Set output format \a format of decoded text.
+  void setFormat(LogFormat format) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    format_ = format;
+  }
+
+  /// Decode \a n bytes \a data and output the text of complete records.
+  /// Return -1 if data is corrupted, the buffered data is dropped then.
+  ssize_t decode(const char *data, size_t n) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const char *p = data;
+    const char *end = data + n;
+    if (!pending_.empty()) {
+      pending_.append(data, n);
+      p = pending_.data();
+      end = p + pending_.size();
+    }
+
+    bool ok = true;
+    text_.clear();
+    while (p < end) {
+      ssize_t len = decodeRecord(p, end);
+      if (len == 0)
+        break;
+      if (len < 0) {
+        ok = false;
+        p = end;
+        break;
+      }
+      p += len;
+    }
+
+    std::string rest(p, end);
+    pending_.swap(rest);
+
+    if (!text_.empty())
+      output_(text_.data(), text_.size());
+
+    return ok ? static_cast<ssize_t>(n) : -1;
+  }
+
+  /// Bytes of the incomplete record waiting for the rest.
+  size_t pending() const { return pending_.size(); }
+
+private:
+  struct Site {
+    std::string file;
+    uint32_t line;
+  };
+
+  /// Site ids are allocated in 32 bits, larger ones are corrupted.
+  static const uint64_t kMaxSiteId = std::numeric_limits<uint32_t>::max();
+
+  /// Appends formatted fields of LogPattern to the text.
+  struct TextOut {
+    std::string &text;
+
+    void append(const char *data, size_t n) { text.append(data, n); }
+
+    template <size_t N, typename Format> void appendFormat(Format format) {
+      char buf[N];
+      text.append(buf, format(buf));
+    }
+  };
+
+  /// Read \a n raw bytes to \a v , return false if incomplete.
+  static bool readRaw(const char *&p, const char *end, void *v, size_t n) {
+    if (static_cast<size_t>(end - p) < n)
+      return false;
+    memcpy(v, p, n);
+    p += n;
+    return true;
+  }
+
+  static bool readVarint(const char *&p, const char *end, uint64_t *v) {
+    size_t len = decodeVarint(p, end, v);
+    p += len;
+    return len != 0;
+  }
+
+  /// Decode a record starting at \a begin , return its length, 0 if it is
+  /// incomplete or -1 if it is corrupted.
+  ssize_t decodeRecord(const char *begin, const char *end) {
+    const char *p = begin + 1;
+    uint64_t id = 0;
+
+    if (*begin == kTagSite) {
+      uint64_t line = 0, len = 0;
+      if (!readVarint(p, end, &id) || !readVarint(p, end, &line) ||
+          !readVarint(p, end, &len) || static_cast<uint64_t>(end - p) < len)
+        return 0;
+      if (id > kMaxSiteId)
+        return -1;
+      Site &site = sites_[static_cast<uint32_t>(id)];
+      site.file.assign(p, len);
+      site.line = static_cast<uint32_t>(line);
+      return p + len - begin;
+    }
+
+    if (*begin != kTagLog)
+      return -1;
+
+    uint8_t level = 0;
+    int64_t time = 0;
+    uint64_t tid = 0;
+    if (!readVarint(p, end, &id) || !readRaw(p, end, &level, 1) ||
+        !readRaw(p, end, &time, sizeof(time)) || !readVarint(p, end, &tid))
+      return 0;
+    if (level > kFatal || id > kMaxSiteId)
+      return -1;
+
+    // the site record may be dropped by overflow policy, output the log
+    // without location.
+    LogLoc loc;
+    auto it = sites_.find(static_cast<uint32_t>(id));
+    if (it != sites_.end())
+      loc = LogLoc(it->second.file.c_str(), "", it->second.line);
+
+    size_t textLen = text_.size();
+    Time t{Time::TimePoint(std::chrono::nanoseconds(time))};
+    first_ = !pattern_.format(out_, true, format_,
+                              static_cast<LogLevel>(level), t, tid, loc);
+    message_ = kNotStarted;
+    value_ = false;
+
+    ssize_t ret = decodeArgs(p, end);
+    if (ret <= 0) {
+      text_.resize(textLen);
+      return ret;
+    }
+    if (format_ != kTextFormat && message_ == kNotStarted)
+      openMessage();
+    closeMessage();
+    pattern_.format(out_, false, format_, static_cast<LogLevel>(level), t,
+                    tid, loc);
+    text_.push_back('\n');
+    return p - begin;
+  }
+
+  /// Decode arguments until kTagEnd, return 1 if success.
+  ssize_t decodeArgs(const char *&p, const char *end) {
+    char buf[kMaxFloatLen];
+
+    while (p < end) {
+      uint8_t tag = static_cast<uint8_t>(*p++);
+      uint64_t u = 0;
+
+      switch (tag) {
+      case kTagEnd:
+        return 1;
+      case kTagSigned:
+        if (!readVarint(p, end, &u))
+          return 0;
+        putRaw(buf, formatInt(static_cast<int64_t>(u >> 1) ^
+                                  -static_cast<int64_t>(u & 1),
+                              buf));
+        break;
+      case kTagUnsigned:
+        if (!readVarint(p, end, &u))
+          return 0;
+        putRaw(buf, formatInt(u, buf));
+        break;
+      case kTagTrue:
+        putRaw("true", 4);
+        break;
+      case kTagFalse:
+        putRaw("false", 5);
+        break;
+      case kTagChar:
+        if (p == end)
+          return 0;
+        putString(p++, 1);
+        break;
+      case kTagFloat: {
+        float f;
+        if (!readRaw(p, end, &f, sizeof(f)))
+          return 0;
+        putFloat(f, buf, formatFloat(f, buf));
+        break;
+      }
+      case kTagDouble: {
+        double d;
+        if (!readRaw(p, end, &d, sizeof(d)))
+          return 0;
+        putFloat(d, buf, formatFloat(d, buf));
+        break;
+      }
+      case kTagFixed: {
+        double d;
+        int8_t precision;
+        if (!readRaw(p, end, &d, sizeof(d)) ||
+            !readRaw(p, end, &precision, sizeof(precision)))
+          return 0;
+        putFloat(d, buf, formatFloatFixed(d, buf, precision));
+        break;
+      }
+      case kTagString:
+        if (!readVarint(p, end, &u) || static_cast<uint64_t>(end - p) < u)
+          return 0;
+        putString(p, u);
+        p += u;
+        break;
+      case kTagKey:
+        if (!readVarint(p, end, &u) || static_cast<uint64_t>(end - p) < u)
+          return 0;
+        closeMessage();
+        key_.assign(p, u);
+        appendKey(out_, format_, key_.c_str(), first_);
+        first_ = false;
+        value_ = true;
+        p += u;
+        break;
+      default:
+        return -1;
+      }
+    }
+
+    return 0;
+  }
+
+  /// Start the message, see LogLine.
+  void openMessage() {
+    if (message_ == kStarted)
+      return;
+
+    if (format_ != kTextFormat) {
+      appendKey(out_, format_, "msg", first_);
+      text_.push_back('"');
+    } else if (!first_) {
+      text_.push_back(' ');
+    }
+    message_ = kStarted;
+    first_ = false;
+  }
+
+  /// Close the message before a field.
+  void closeMessage() {
+    if (message_ != kStarted)
+      return;
+
+    if (format_ != kTextFormat)
+      text_.push_back('"');
+    message_ = kClosed;
+  }
+
+  /// Output a number or bool \a data with length \a n to message or field.
+  void putRaw(const char *data, size_t n) {
+    if (!value_)
+      openMessage();
+    value_ = false;
+    text_.append(data, n);
+  }
+
+  /// Output float number \a v formatted as \a data with length \a n , NaN and
+  /// infinity fields are null in JSON.
+  void putFloat(double v, const char *data, size_t n) {
+    if (value_ && format_ == kJsonFormat && !std::isfinite(v))
+      putRaw("null", 4);
+    else
+      putRaw(data, n);
+  }
+
+  /// Output string \a data with length \a n to message or field.
+  void putString(const char *data, size_t n) {
+    if (value_) {
+      appendValue(out_, format_, data, n);
+      value_ = false;
+      return;
+    }
+
+    openMessage();
+    if (format_ == kTextFormat)
+      text_.append(data, n);
+    else
+      appendEscaped(out_, data, n);
+  }
+
+  enum MessageState : uint8_t { kNotStarted, kStarted, kClosed };
+
+  OutputFunc output_;
+  LogPattern pattern_;
+  LogFormat format_;
+  std::mutex mutex_;
+  std::string pending_; // incomplete record.
+  std::string text_;
+  TextOut out_; // appends to text_.
+  std::unordered_map<uint32_t, Site> sites_; // by id, ids may be sparse.
+
+  // state of the record being decoded.
+  MessageState message_;
+  bool first_; // no field or message is output after the prefix yet.
+  bool value_; // the next argument is the value of a field.
+  std::string key_;
 };
 } // namespace limlog
 
-/// Create a logline with log level \a level and the log location \a loc .
+/// Log levels below LIMLOG_MIN_LEVEL are eliminated at compile time, e.g.
+/// define it to limlog::kInfo before including limlog.h to strip the trace
+/// and debug logs and their arguments from release builds.
+#ifndef LIMLOG_MIN_LEVEL
+#define LIMLOG_MIN_LEVEL limlog::kTrace
+#endif
+
+/// Static LogSite of the log statement with the log location \a loc , which
+/// must be the same in each run, i.e. made of __FILE__ and __LINE__.
+#define LIMLOG_SITE(loc)                                                       \
+  [](const limlog::LogLoc &l) -> limlog::LogSite & {                           \
+    static limlog::LogSite s_site(l);                                          \
+    return s_site;                                                             \
+  }(loc)
+
+/// Create a logline with log level \a level , the LogSite pointer \a site
+/// which is nullptr if the log is disabled, and the log location \a loc .
+/// Define LIMLOG_BINARY before including limlog.h to log in binary, and decode
+/// it with BinaryDecoder.
+#ifdef LIMLOG_BINARY
+#define LIMLOG_LOG(level, site, loc)                                           \
+  if ((level) < LIMLOG_MIN_LEVEL) {                                            \
+  } else                                                                       \
+    for (limlog::LogSite *limlog_site = (site); limlog_site;                   \
+         limlog_site = nullptr)                                                \
+      limlog::BinaryLogLine(level, *limlog_site)
+#else
+#define LIMLOG_LOG(level, site, loc)                                           \
+  if ((level) < LIMLOG_MIN_LEVEL) {                                            \
+  } else                                                                       \
+    for (limlog::LogSite *limlog_site = (site); limlog_site;                   \
+         limlog_site = nullptr)                                                \
+      limlog::LogLine(level, loc)
+#endif
+
+/// Create a logline with log level \a level and the log location \a loc ,
+/// which may change in each run, e.g. forwarded from other logs. Its site is
+/// looked up by RuntimeSites::find(), so prefer LOG_LOC() for the fixed
+/// location.
 #define LOG(level, loc)                                                        \
-  if (limlog::singleton()->getLogLevel() <= level)                             \
-  limlog::LogLine(level, loc)
+  LIMLOG_LOG(level, limlog::RuntimeSites::find(level, loc), loc)
 
 /// Create a logline with log level \a level and the log localtion.
 #define LOG_LOC(level)                                                         \
-  LOG(level, limlog::LogLoc(__FILE__, __FUNCTION__, __LINE__))
+  LIMLOG_LOG(level,                                                            \
+             LIMLOG_SITE(limlog::LogLoc(__FILE__, __FUNCTION__, __LINE__))     \
+                 .check(level),                                                \
+             limlog::LogLoc(__FILE__, __FUNCTION__, __LINE__))
 
 #define LOG_TRACE LOG_LOC(limlog::LogLevel::kTrace)
 #define LOG_DEBUG LOG_LOC(limlog::LogLevel::kDebug)
@@ -2,6 +2,14 @@
 //
 /// \file
 /// Benchmark.
+///
+/// Usage: Benchmark [-n LINES] [-t THREADS] [-f text|json]
+/// Sweep thread count 1, 2, 4 ... THREADS (default the number of cores),
+/// payloads and sinks, each thread logs LINES lines (default 50000). The
+/// latency of each log call is measured with rdtsc into a histogram, and a
+/// result is output per line as 'key=value' pairs or a JSON object.
+/// Define LIMLOG_ASYNC (make CXXFLAGS+=-DLIMLOG_ASYNC) to benchmark the
+/// background thread output.
 //
 // Author:  zxh(definezxh@163.com)
 // Date:    2019/12/12 11:41:58
@@ -10,118 +18,246 @@
 #include <limlog.h>
 
 #include <inttypes.h>
+#include <string.h>
+
+using namespace limlog;
+
+static int g_lineCount = 50000;
+static bool g_json = false;
+
+/// A result output as a line of 'key=value' pairs, or a JSON object.
+class Record {
+public:
+  Record &add(const char *key, const char *value) {
+    if (g_json)
+      return append(key, "\"" + std::string(value) + "\"");
+    return append(key, value);
+  }
+
+  Record &add(const char *key, uint64_t value) {
+    return append(key, std::to_string(value));
+  }
+
+  Record &add(const char *key, double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f", value);
+    return append(key, buf);
+  }
+
+  void print() const {
+    if (g_json)
+      fprintf(stdout, "{%s}\n", line_.c_str());
+    else
+      fprintf(stdout, "%s\n", line_.c_str());
+    fflush(stdout);
+  }
+
+private:
+  Record &append(const char *key, const std::string &value) {
+    if (!line_.empty())
+      line_ += g_json ? "," : " ";
+    if (g_json)
+      line_ += "\"" + std::string(key) + "\":" + value;
+    else
+      line_ += std::string(key) + "=" + value;
+    return *this;
+  }
+
+  std::string line_;
+};
+
+/// Tick counter of the latency, rdtsc if it is available.
+uint64_t ticks() {
+#ifdef LIMLOG_HAS_TSC
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+/// Nanoseconds per tick, measured against steady clock for 50 ms.
+double nsPerTick() {
+  static double s_rate = [] {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t tick = ticks();
+    std::chrono::nanoseconds elapsed;
+    while ((elapsed = std::chrono::steady_clock::now() - start) <
+           std::chrono::milliseconds(50))
+      ;
+    return static_cast<double>(elapsed.count()) / (ticks() - tick);
+  }();
+  return s_rate;
+}
 
-const int kLogTestCount = 1000000;
-const int kTestThreadCount = 1;
+/// Log-linear histogram like HdrHistogram, values below 2^(kSubBits + 1) are
+/// exact, and the larger are in buckets of 1/2^kSubBits relative width, so
+/// the percentiles are within about 3% whatever the range is.
+class Histogram {
+public:
+  static constexpr size_t kSubBits = 5;
+  static constexpr size_t kSubCount = 1 << kSubBits;
+  static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSubCount;
+
+  Histogram() : counts_(kBuckets), count_(0), max_(0) {}
+
+  void record(uint64_t v) {
+    counts_[index(v)]++;
+    count_++;
+    max_ = std::max(max_, v);
+  }
+
+  void merge(const Histogram &h) {
+    for (size_t i = 0; i < kBuckets; ++i)
+      counts_[i] += h.counts_[i];
+    count_ += h.count_;
+    max_ = std::max(max_, h.max_);
+  }
+
+  /// Value of percentile \a p in (0, 100], the highest value of the bucket.
+  uint64_t percentile(double p) const {
+    uint64_t target = static_cast<uint64_t>(p / 100 * count_ + 0.5);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      sum += counts_[i];
+      if (sum >= std::max<uint64_t>(target, 1))
+        return std::min(highest(i), max_);
+    }
+    return max_;
+  }
+
+  uint64_t max() const { return max_; }
+
+private:
+  static size_t index(uint64_t v) {
+    size_t bits = bitWidth(v);
+    if (bits <= kSubBits + 1)
+      return v;
+    size_t shift = bits - kSubBits - 1;
+    return shift * kSubCount + (v >> shift);
+  }
+
+  static uint64_t highest(size_t i) {
+    if (i < 2 * kSubCount)
+      return i;
+    size_t shift = i / kSubCount - 1;
+    return ((i % kSubCount + kSubCount + 1) << shift) - 1;
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  uint64_t max_;
+};
+
+/// Output counted by the benchmark threads each, and by the background thread
+/// of async logger. Padded to not share cache line with each other.
+struct OutputCounter {
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> lines; // counted in async only.
+  char pad[64];
+};
+
+static thread_local OutputCounter *t_counter = nullptr;
+static OutputCounter g_backendCounter;
+static int g_sinkFd = -1;
+
+void count(const char *data, size_t n) {
+  OutputCounter *c = t_counter ? t_counter : &g_backendCounter;
+  c->bytes.fetch_add(n, std::memory_order_relaxed);
+  if (DefaultLogger::kAsync)
+    c->lines.fetch_add(std::count(data, data + n, '\n'),
+                       std::memory_order_relaxed);
+}
 
-uint64_t sys_clock_now() {
-  return std::chrono::duration_cast<std::chrono::microseconds>(
-             std::chrono::system_clock().now().time_since_epoch())
-      .count();
+ssize_t null_sink(const char *data, size_t n) {
+  count(data, n);
+  return n;
+}
+
+ssize_t fd_sink(const char *data, size_t n) {
+  count(data, n);
+  size_t written = 0;
+  while (written < n) {
+    ssize_t r = ::write(g_sinkFd, data + written, n - written);
+    if (r <= 0)
+      break;
+    written += r;
+  }
+  return written;
+}
+
+/// Sink of logs, set up and torn down around a run.
+struct Sink {
+  const char *name;
+  OutputFunc output;
+  bool (*open)();
+  void (*close)();
+};
+
+static const char *kFilePath = "Benchmark.log";
+
+bool open_file() {
+  g_sinkFd = ::open(kFilePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  return g_sinkFd >= 0;
 }
 
-#define LOG_TIME(func, type, n, idx)                                           \
+void close_file() {
+  ::close(g_sinkFd);
+  ::unlink(kFilePath);
+}
+
+// Read end of pipe is drained by a reader thread.
+static std::thread g_pipeReader;
+
+bool open_pipe() {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return false;
+
+  g_sinkFd = fds[1];
+  g_pipeReader = std::thread([fds] {
+    char buf[64 * 1024];
+    while (::read(fds[0], buf, sizeof(buf)) > 0)
+      ;
+    ::close(fds[0]);
+  });
+  return true;
+}
+
+void close_pipe() {
+  ::close(g_sinkFd);
+  g_pipeReader.join();
+}
+
+bool open_none() { return true; }
+void close_none() {}
+
+static const Sink kSinks[] = {{"null", null_sink, open_none, close_none},
+                              {"file", fd_sink, open_file, close_file},
+                              {"pipe", fd_sink, open_pipe, close_pipe}};
+
+/// Log \a n lines of a payload, record latency of each into \a h .
+struct Payload {
+  const char *name;
+  void (*log)(int n, Histogram &h);
+};
+
+// Measure latency of a log statement.
+#define LOG_LATENCY(h, stmt)                                                   \
   do {                                                                         \
-    uint64_t start = sys_clock_now();                                          \
-    func();                                                                    \
-    uint64_t end = sys_clock_now();                                            \
-    fprintf(stdout,                                                            \
-            "thread: %d, %d (%s) logs takes %" PRIu64                          \
-            " us, average: %.2lf us\n",                                        \
-            idx, kLogTestCount *n, type, end - start,                          \
-            static_cast<double>(end - start) / kLogTestCount / n);             \
+    uint64_t start = ticks();                                                  \
+    stmt;                                                                      \
+    uint64_t end = ticks();                                                    \
+    (h).record(end > start ? end - start : 0);                                 \
   } while (0)
 
-void log_1_same_element_x6() {
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << i;
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << 3.14159;
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << true;
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << 'c';
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << "c@string";
-
-  std::string str = "std::string";
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << str;
-}
-
-void log_4_same_element_x6() {
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << i << i + 1 << i + 2 << i + 3;
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << 3.14159 << 1.12312 << 1.01 << 1.1;
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << true << false << true << false;
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << 'c' << 'd' << 'e' << 'f';
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << "c@string"
-              << "hello"
-              << "world"
-              << "the c program";
-
-  std::string str = "std::string";
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << str << str << str << str;
-}
-
-void log_16_same_element_x6() {
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << i << i + 1 << i + 2 << i + 3 << i + 4 << i + 5 << i + 6
-              << i + 7 << i + 8 << i + 9 << i + 10 << i + 11 << i + 12 << i + 13
-              << i + 14 << i + 15;
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << 3.14159 << 1.12312 << 1.01 << 1.1 << 3.14159 << 1.12312 << 1.01
-              << 1.1 << 3.14159 << 1.12312 << 1.01 << 1.1 << 3.14159 << 1.12312
-              << 1.01 << 1.1;
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << true << false << true << false << true << false << true
-              << false << true << false << true << false << true << false
-              << true << false;
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << 'c' << 'd' << 'e' << 'f' << 'c' << 'd' << 'e' << 'f' << 'c'
-              << 'd' << 'e' << 'f' << 'c' << 'd' << 'e' << 'f';
-
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << "c@string"
-              << "hello"
-              << "world"
-              << "the c program"
-              << "c@string"
-              << "hello"
-              << "world"
-              << "the c program"
-              << "c@string"
-              << "hello"
-              << "world"
-              << "the c program"
-              << "c@string"
-              << "hello"
-              << "world"
-              << "the c program";
-
-  std::string str("std::string");
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << str << str << str << str << str << str << str << str << str
-              << str << str << str << str << str << str << str;
+void log_int(int n, Histogram &h) {
+  for (int i = 0; i < n; ++i)
+    LOG_LATENCY(h, LOG_INFO << i);
 }
 
-void log_10_diff_element_x1() {
+void log_mixed(int n, Histogram &h) {
   char ch = 'a';
   int16_t int16 = INT16_MIN;
   uint16_t uint16 = UINT16_MAX;
@@ -132,104 +268,201 @@ void log_10_diff_element_x1() {
   double d = 1.844674;
   std::string str("std::string");
 
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << ch << int16 << uint16 << int32 << uint32 << int64 << uint64
-              << d << "c@string" << str;
+  for (int i = 0; i < n; ++i)
+    LOG_LATENCY(h, LOG_INFO << ch << int16 << uint16 << int32 << uint32
+                            << int64 << uint64 << d << "c@string" << str);
 }
 
-void log_10_diff_element_len(const char *data, size_t n, const char *type,
-                             int thread_idx) {
-  char ch = 'a';
-  int16_t int16 = INT16_MIN;
-  uint16_t uint16 = UINT16_MAX;
-  int32_t int32 = INT32_MIN;
-  uint32_t uint32 = UINT32_MAX;
-  int64_t int64 = INT64_MIN;
-  uint64_t uint64 = UINT64_MAX;
-  double d = 1.844674;
-  std::string str("std::string");
-  uint64_t start = sys_clock_now();
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << ch << int16 << uint16 << int32 << uint32 << int64 << uint64
-              << d << "c@string" << str << data;
+template <size_t N> void log_string(int n, Histogram &h) {
+  std::string str(N, 's');
+  for (int i = 0; i < n; ++i)
+    LOG_LATENCY(h, LOG_INFO << "string " << i << ' ' << str);
+}
 
-  uint64_t end = sys_clock_now();
-  fprintf(stdout,
-          "thread: %d, %d (%s) logs takes %" PRIu64 " us, average: %.2lf us\n",
-          thread_idx, kLogTestCount, type, end - start,
-          static_cast<double>(end - start) / kLogTestCount);
+static const Payload kPayloads[] = {{"int", log_int},
+                                    {"mixed", log_mixed},
+                                    {"str64", log_string<64>},
+                                    {"str1024", log_string<1024>}};
+
+// Wait for the background thread to output \a lines lines.
+void wait_output(uint64_t lines) {
+  while (DefaultLogger::kAsync &&
+         g_backendCounter.lines.load(std::memory_order_relaxed) < lines) {
+    singleton()->flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
 }
 
-void log_10_diff_element_len(const std::string &s, const char *type,
-                             int thread_idx) {
-  char ch = 'a';
-  int16_t int16 = INT16_MIN;
-  uint16_t uint16 = UINT16_MAX;
-  int32_t int32 = INT32_MIN;
-  uint32_t uint32 = UINT32_MAX;
-  int64_t int64 = INT64_MIN;
-  uint64_t uint64 = UINT64_MAX;
-  double d = 1.844674;
-  std::string str("std::string");
-  uint64_t start = sys_clock_now();
-  for (int i = 0; i < kLogTestCount; ++i)
-    LOG_DEBUG << ch << int16 << uint16 << int32 << uint32 << int64 << uint64
-              << d << "c@string" << str << s;
-
-  uint64_t end = sys_clock_now();
-  fprintf(stdout,
-          "thread: %d, %d (%s) logs takes %" PRIu64 " us, average: %.2lf us\n",
-          thread_idx, kLogTestCount, type, end - start,
-          static_cast<double>(end - start) / kLogTestCount);
-}
-
-void log_10_diff_element_str(int thread_idx) {
-  std::string str(64, '1');
-  log_10_diff_element_len(
-      str.c_str(), 64, "10 diff element logs + 64 bytes c@string", thread_idx);
-  log_10_diff_element_len(str, "10 diff element logs + 64 bytes std::string",
-                          thread_idx);
-
-  str = std::string(256, '2');
-  log_10_diff_element_len(str.c_str(), 256,
-                          "10 diff element logs + 256 bytes c@string",
-                          thread_idx);
-  log_10_diff_element_len(str, "10 diff element logs + 256 bytes std::string",
-                          thread_idx);
-
-  str = std::string(1024, '3');
-  log_10_diff_element_len(str.c_str(), 1024,
-                          "10 diff element logs + 1024 bytes c@string",
-                          thread_idx);
-  log_10_diff_element_len(str, "10 diff element logs + 1024 bytes std::string",
-                          thread_idx);
-
-  str = std::string(4096, '4');
-  log_10_diff_element_len(str.c_str(), 4096,
-                          "10 diff element logs + 4096 bytes c@string",
-                          thread_idx);
-  log_10_diff_element_len(str, "10 diff element logs + 4096 bytes std::string",
-                          thread_idx);
-}
-
-void benchmark(int thread_idx) {
-  LOG_TIME(log_1_same_element_x6, "1 same element logs x 6", 6, thread_idx);
-  LOG_TIME(log_4_same_element_x6, "4 same element logs x 6", 6, thread_idx);
-  LOG_TIME(log_16_same_element_x6, "16 same element logs x 6", 6, thread_idx);
-  LOG_TIME(log_10_diff_element_x1, "10 diff element logs x 1", 1, thread_idx);
-  log_10_diff_element_str(thread_idx);
-}
-
-int main() {
-  limlog::singleton()->setLogLevel(limlog::LogLevel::kDebug);
-  limlog::singleton()->setOutput(limlog::NullWriter::write);
+// Run \a payload in \a threadCount threads to \a sink .
+void run(const Sink &sink, const Payload &payload, int threadCount) {
+  if (!sink.open()) {
+    fprintf(stderr, "Benchmark: cannot open sink '%s'\n", sink.name);
+    return;
+  }
+  singleton()->setOutput(sink.output);
+
+  std::vector<Histogram> histograms(threadCount);
+  std::unique_ptr<OutputCounter[]> counters(new OutputCounter[threadCount]);
+  g_backendCounter.bytes = 0;
+  g_backendCounter.lines = 0;
+  std::atomic<int> ready(0);
+  std::atomic<bool> go(false);
 
   std::vector<std::thread> threads;
-  for (int i = 0; i < kTestThreadCount; ++i)
-    threads.emplace_back(std::thread(benchmark, i));
+  for (int i = 0; i < threadCount; ++i) {
+    counters[i].bytes = 0;
+    counters[i].lines = 0;
+    threads.emplace_back([&, i] {
+      t_counter = &counters[i];
+      // the logger of thread is created by the first log.
+      LOG_INFO << "warm up";
+      ready++;
+      while (!go)
+        ;
+      payload.log(g_lineCount, histograms[i]);
+      singleton()->flush();
+    });
+  }
+
+  // output of the warm up logs are not counted.
+  while (ready != threadCount)
+    ;
+  wait_output(threadCount);
+  for (int i = 0; i < threadCount; ++i)
+    counters[i].bytes = 0;
+  g_backendCounter.bytes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  go = true;
+  for (auto &t : threads)
+    t.join();
+  uint64_t lines = static_cast<uint64_t>(g_lineCount) * threadCount;
+  wait_output(lines + threadCount);
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  Histogram h;
+  uint64_t bytes = g_backendCounter.bytes;
+  for (int i = 0; i < threadCount; ++i) {
+    h.merge(histograms[i]);
+    bytes += counters[i].bytes;
+  }
+
+  singleton()->setOutput(NullWriter::write);
+  sink.close();
+
+  double ns = nsPerTick();
+  Record()
+      .add("mode", DefaultLogger::kAsync ? "async" : "sync")
+      .add("threads", static_cast<uint64_t>(threadCount))
+      .add("payload", payload.name)
+      .add("sink", sink.name)
+      .add("lines", lines)
+      .add("bytes", bytes)
+      .add("lines_per_sec", lines / seconds)
+      .add("mb_per_sec", bytes / seconds / (1024 * 1024))
+      .add("p50_ns", h.percentile(50) * ns)
+      .add("p99_ns", h.percentile(99) * ns)
+      .add("p999_ns", h.percentile(99.9) * ns)
+      .add("max_ns", h.max() * ns)
+      .print();
+}
+
+// Producer thread copies logs into BlockingBuffer and consumer thread takes
+// them out in batch, measures the throughput of buffer only.
+void blocking_buffer_throughput(uint32_t log_len) {
+  const uint64_t kTotalBytes = 1024ULL * 1024 * 1024; // 1 GB
+  std::unique_ptr<BlockingBuffer> buf(new BlockingBuffer);
+  uint64_t count = kTotalBytes / log_len;
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread consumer([&] {
+    std::unique_ptr<char[]> batch(new char[64 * 1024]);
+    uint64_t consumed = 0;
+    while (consumed < count * log_len) {
+      uint32_t n = buf->consume(batch.get(), 64 * 1024);
+      if (n == 0)
+        std::this_thread::yield();
+      consumed += n;
+    }
+  });
+
+  std::string log(log_len, 'x');
+  for (uint64_t i = 0; i < count; ++i) {
+    buf->produce(log.data(), log_len);
+    buf->incConsumablePos(log_len);
+  }
+  consumer.join();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  Record()
+      .add("bench", "blocking_buffer")
+      .add("log_len", static_cast<uint64_t>(log_len))
+      .add("lines_per_sec", count / seconds)
+      .add("mb_per_sec", count * log_len / seconds / (1024 * 1024))
+      .print();
+}
+
+// Cost of timestamp from clock source \a source .
+void clock_source_cost(ClockSource source, const char *type) {
+  const int kCount = 1000000;
+  Time::setClockSource(source);
+  volatile int64_t sum = 0; // keep the calls.
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kCount; ++i)
+    sum = sum + Time::now().count();
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+  Time::setClockSource(kSystemClock);
+
+  Record()
+      .add("bench", "clock_source")
+      .add("clock", type)
+      .add("ns_per_call", static_cast<double>(elapsed.count()) / kCount)
+      .print();
+}
 
-  for (int i = 0; i < kTestThreadCount; ++i)
-    threads[i].join();
+int main(int argc, char *argv[]) {
+  int maxThreads = std::max<int>(std::thread::hardware_concurrency(), 1);
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *opt = argv[i];
+    const char *arg = argv[i + 1];
+    if (strcmp(opt, "-n") == 0 && atoi(arg) > 0) {
+      g_lineCount = atoi(arg);
+    } else if (strcmp(opt, "-t") == 0 && atoi(arg) > 0) {
+      maxThreads = atoi(arg);
+    } else if (strcmp(opt, "-f") == 0 && strcmp(arg, "text") == 0) {
+      g_json = false;
+    } else if (strcmp(opt, "-f") == 0 && strcmp(arg, "json") == 0) {
+      g_json = true;
+    } else {
+      fprintf(stderr, "Benchmark: invalid option '%s %s'\n", opt, arg);
+      return 1;
+    }
+  }
+
+  blocking_buffer_throughput(16);
+  blocking_buffer_throughput(64);
+  blocking_buffer_throughput(256);
+
+  clock_source_cost(kSystemClock, "system");
+  clock_source_cost(kCoarseClock, "coarse");
+  clock_source_cost(kTscClock, "tsc");
+
+  singleton()->setLogLevel(kInfo);
+  nsPerTick();
+
+  std::vector<int> threadCounts;
+  for (int n = 1; n < maxThreads; n *= 2)
+    threadCounts.push_back(n);
+  threadCounts.push_back(maxThreads);
+
+  for (const Sink &sink : kSinks)
+    for (const Payload &payload : kPayloads)
+      for (int n : threadCounts)
+        run(sink, payload, n);
 
   return 0;
 }
@@ -0,0 +1,200 @@
+//===- BinaryLogTest.cpp - Binary Log Test ----------------------*- C++ -*-===//
+//
+/// \file
+/// BinaryLogLine and BinaryDecoder Test routine.
+//
+// Author:  zxh
+// Date:    2022/03/19 14:26:37
+//===----------------------------------------------------------------------===//
+
+#define LIMLOG_BINARY
+
+#include "Test.h"
+
+#include <limlog.h>
+
+using namespace limlog;
+
+static std::string g_binary;
+static std::string g_text;
+
+ssize_t capture_binary(const char *data, size_t n) {
+  g_binary.append(data, n);
+  return n;
+}
+
+ssize_t capture_text(const char *data, size_t n) {
+  g_text.append(data, n);
+  return n;
+}
+
+// Drop the time field which is the second one.
+std::string strip_time(const std::string &s) {
+  std::string r;
+  size_t pos = 0;
+  while (pos < s.size()) {
+    size_t end = s.find('\n', pos);
+    std::string line = s.substr(pos, end - pos);
+    size_t t = line.find(' ');
+    size_t tEnd = line.find(' ', t + 1);
+    r += line.substr(0, t) + line.substr(tEnd) + "\n";
+    pos = end + 1;
+  }
+  return r;
+}
+
+static int g_info_line = 0;
+static int g_warn_line = 0;
+
+void log_lines() {
+  g_info_line = __LINE__ + 2;
+  for (int i = 0; i < 3; ++i)
+    LOG_INFO << "loop " << i << ' ' << -i * 1000000007LL << ' ' << (i == 1);
+
+  int16_t int16 = INT16_MIN;
+  uint64_t uint64 = UINT64_MAX;
+  std::string str("std::string");
+  g_warn_line = __LINE__ + 1;
+  LOG_WARN << int16 << ' ' << uint64 << ' ' << 1.5 << ' ' << 0.1f << ' '
+           << fixed(3.14159, 2) << ' ' << str;
+  LOG(kError, LogLoc()) << "no location";
+}
+
+void test_binary_log() {
+  singleton()->setOutput(capture_binary);
+  log_lines();
+
+  std::string tid = std::to_string(limlog::gettid());
+  std::string info = "INFO " + tid + " BinaryLogTest.cpp:" +
+                     std::to_string(g_info_line) + " loop ";
+  std::string warn = "WARN " + tid + " BinaryLogTest.cpp:" +
+                     std::to_string(g_warn_line) + " ";
+  std::string expect =
+      info + "0 0 false\n" + info + "1 -1000000007 true\n" + info +
+      "2 -2000000014 false\n" + warn +
+      "-32768 18446744073709551615 1.5 0.1 3.14 std::string\n" + "ERRO " +
+      tid + " no location\n";
+
+  BinaryDecoder decoder;
+  decoder.setOutput(capture_text);
+  TEST_SIZE_EQ(decoder.decode(g_binary.data(), g_binary.size()),
+               g_binary.size());
+  TEST_SIZE_EQ(decoder.pending(), 0);
+  TEST_STRING_EQ(strip_time(g_text), expect);
+
+  // feed byte by byte.
+  BinaryDecoder bytewise;
+  bytewise.setOutput(capture_text);
+  g_text.clear();
+  for (char c : g_binary)
+    bytewise.decode(&c, 1);
+  TEST_SIZE_EQ(bytewise.pending(), 0);
+  TEST_STRING_EQ(strip_time(g_text), expect);
+
+  // the site records are output only once for each thread.
+  size_t size = g_binary.size();
+  g_binary.clear();
+  log_lines();
+  TEST_INT_EQ(g_binary.size() < size, true);
+  g_text.clear();
+  decoder.decode(g_binary.data(), g_binary.size());
+  TEST_STRING_EQ(strip_time(g_text), expect);
+
+  // decode in pattern.
+  decoder.setPattern("%l: %m");
+  g_text.clear();
+  decoder.decode(g_binary.data(), g_binary.size());
+  std::string loop = std::to_string(g_info_line) + ": loop ";
+  TEST_STRING_EQ(g_text, loop + "0 0 false\n" + loop + "1 -1000000007 true\n" +
+                             loop + "2 -2000000014 false\n" +
+                             std::to_string(g_warn_line) +
+                             ": -32768 18446744073709551615 1.5 0.1 3.14 "
+                             "std::string\nno location\n");
+
+  // corrupted data.
+  TEST_INT_EQ(static_cast<int>(decoder.decode("\x7f", 1)), -1);
+  TEST_SIZE_EQ(decoder.pending(), 0);
+}
+
+// Site record of \a id with line 7 and file "a.cc".
+std::string site_record(uint64_t id) {
+  char buf[16];
+  std::string r(1, static_cast<char>(kTagSite));
+  r.append(buf, encodeVarint(id, buf));
+  return r + "\x07\x04" + "a.cc";
+}
+
+// Log record of site \a id with message "m".
+std::string log_record(uint64_t id) {
+  char buf[16];
+  int64_t time = 0;
+  std::string r(1, static_cast<char>(kTagLog));
+  r.append(buf, encodeVarint(id, buf));
+  r += static_cast<char>(kInfo);
+  r.append(reinterpret_cast<const char *>(&time), sizeof(time));
+  r += '\x01';
+  r += static_cast<char>(kTagString);
+  return r + "\x01m" + static_cast<char>(kTagEnd);
+}
+
+void test_binary_site_id() {
+  BinaryDecoder decoder;
+  decoder.setOutput(capture_text);
+  decoder.setPattern("%f:%l %m");
+
+  // sparse ids.
+  std::string data = site_record(1u << 30) + log_record(1u << 30) +
+                     log_record(3);
+  g_text.clear();
+  TEST_SIZE_EQ(decoder.decode(data.data(), data.size()), data.size());
+  TEST_STRING_EQ(g_text, "a.cc:7 m\nm\n");
+
+  // ids out of 32 bits are corrupted.
+  data = site_record(1ULL << 49);
+  TEST_INT_EQ(static_cast<int>(decoder.decode(data.data(), data.size())), -1);
+  data = log_record(1ULL << 49);
+  TEST_INT_EQ(static_cast<int>(decoder.decode(data.data(), data.size())), -1);
+  TEST_SIZE_EQ(decoder.pending(), 0);
+}
+
+void test_binary_fields() {
+  g_binary.clear();
+  singleton()->setOutput(capture_binary);
+  LOG_INFO.kv("user", 42) << "login \"" << 'x' << '"' << kv("ok", true)
+                          << kv("peer", "a b") << kv("rate", 1.0 / 0.0)
+                          << kv("id", hex(255, 4)) << width(-7, 3);
+
+  BinaryDecoder decoder;
+  decoder.setOutput(capture_text);
+  decoder.setPattern("%L %m");
+
+  g_text.clear();
+  decoder.decode(g_binary.data(), g_binary.size());
+  TEST_STRING_EQ(g_text,
+                 "INFO user=42 login \"x\" ok=true peer=a b rate=inf "
+                 "id=00ff -07\n");
+
+  decoder.setFormat(kJsonFormat);
+  g_text.clear();
+  decoder.decode(g_binary.data(), g_binary.size());
+  TEST_STRING_EQ(g_text, "{\"level\":\"INFO\",\"user\":42,"
+                         "\"msg\":\"login \\\"x\\\"\",\"ok\":true,"
+                         "\"peer\":\"a b\",\"rate\":null,\"id\":\"00ff\","
+                         "\"msg\":\"-07\"}\n");
+
+  decoder.setFormat(kLogfmtFormat);
+  g_text.clear();
+  decoder.decode(g_binary.data(), g_binary.size());
+  TEST_STRING_EQ(g_text, "level=INFO user=42 msg=\"login \\\"x\\\"\" ok=true "
+                         "peer=\"a b\" rate=inf id=\"00ff\" msg=\"-07\"\n");
+}
+
+int main() {
+  test_binary_log();
+  test_binary_site_id();
+  test_binary_fields();
+
+  PRINT_PASS_RATE();
+
+  return !ALL_TEST_PASS();
+}
@@ -57,14 +57,13 @@ void test_blocking_buffer() {
   char *mem_256kb =
       static_cast<char *>(malloc(sizeof(char) * kBytesPerKb * 256));
   char *mem_1mb = static_cast<char *>(malloc(sizeof(char) * kBytesPerMb));
-  char *mem_buf = static_cast<char *>(malloc(sizeof(BlockingBuffer)));
   memset(mem_128b, '1', 128);
   memset(mem_1kb, '2', kBytesPerKb);
   memset(mem_64kb, '3', kBytesPerKb * 64);
   memset(mem_256kb, '4', kBytesPerKb * 256);
   memset(mem_1mb, '5', kBytesPerMb);
 
-  BlockingBuffer *buf = ::new (mem_buf) BlockingBuffer;
+  BlockingBuffer *buf = new BlockingBuffer;
   uint32_t size = buf->size();
   uint32_t used = 0;
   assert(size == kBytesPerMb);
@@ -127,7 +126,7 @@ void test_blocking_buffer() {
   TEST_BUFFER_CONSUMABLE(buf, kBytesPerMb, size, kBytesPerMb, 0, kBytesPerMb);
   TEST_BUFFER_CONSUME(buf, mem_1mb, kBytesPerMb, size, 0, kBytesPerMb, 0);
 
-  free(mem_buf);
+  delete buf;
   free(mem_128b);
   free(mem_1kb);
   free(mem_64kb);
@@ -137,8 +136,122 @@ void test_blocking_buffer() {
 #endif
 }
 
+void test_blocking_buffer_reserve() {
+  BlockingBuffer *buf = new BlockingBuffer;
+  uint32_t size = buf->size();
+  std::string data(size, 'x');
+  char to[64];
+
+  // reserve and commit less than reserved.
+  char *p = buf->reserve(32);
+  TEST_INT_EQ(p != nullptr, true);
+  memcpy(p, "hello", 5);
+  buf->commit(5);
+  TEST_BUFFER(buf, size, 5, size - 5, 0);
+  TEST_BUFFER_CONSUMABLE(buf, 5, size, 5, size - 5, 5);
+  TEST_BUFFER_CONSUME(buf, to, 5, size, 0, size, 0);
+  TEST_STRING_EQ(std::string(to, 5), "hello");
+
+  // space until the end of buffer is insufficient.
+  buf->produce(data.data(), size - 5 - 8);
+  buf->incConsumablePos(size - 5 - 8);
+  TEST_INT_EQ(buf->reserve(16) == nullptr, true);
+  TEST_INT_EQ(buf->reserve(8) != nullptr, true);
+
+  // unused space is insufficient even the wrapped one.
+  buf->produce("12345678", 8);
+  buf->incConsumablePos(8);
+  TEST_INT_EQ(buf->reserve(8) == nullptr, true);
+  buf->consume(size - 5 - 8);
+  TEST_INT_EQ(buf->reserve(16) != nullptr, true);
+  TEST_BUFFER(buf, size, 8, size - 8, 8);
+
+  delete buf;
+}
+
+void test_blocking_buffer_size() {
+  // rounded up to power of 2 within [4 KB, 1 GB].
+  TEST_INT_EQ(BlockingBuffer::roundUpSize(0), 4096);
+  TEST_INT_EQ(BlockingBuffer::roundUpSize(4097), 8192);
+  TEST_INT_EQ(BlockingBuffer::roundUpSize(1 << 24), 1 << 24);
+  TEST_INT_EQ(BlockingBuffer::roundUpSize(UINT32_MAX), 1 << 30);
+
+  BlockingBuffer buf(5000);
+  TEST_BUFFER((&buf), 8192, 0, 8192, 0);
+
+  // the incomplete log is moved to the next buffer, which is larger.
+  std::string data(8000, 'x');
+  char to[8192];
+  buf.produce(data.data(), 6000);
+  buf.incConsumablePos(6000);
+  buf.consume(to, 6000);
+  buf.produce("12345678", 8);
+  buf.incConsumablePos(8);
+  buf.produce(data.data(), 4000); // wraps around.
+
+  BlockingBuffer next(16384);
+  buf.moveIncomplete(&next);
+  buf.seal(&next);
+  TEST_INT_EQ(buf.next() == &next, true);
+  TEST_BUFFER((&buf), 8192, 8, 8192 - 8, 8);
+  TEST_BUFFER((&next), 16384, 4000, 16384 - 4000, 0);
+  TEST_INT_EQ(static_cast<int>(buf.consume(to, sizeof(to))), 8);
+  TEST_STRING_EQ(std::string(to, 8), "12345678");
+}
+
+// The producer discards records while the consumer reads them, the records
+// read are never torn.
+void test_blocking_buffer_discard() {
+  const uint32_t kMaxLen = 3000;
+  const int kRecordCount = 1000000;
+  BlockingBuffer buf(4096);
+  std::atomic<bool> stop(false);
+  std::atomic<int> consumed(0);
+  int torn = 0;
+
+  // record: length of 4 bytes and the bytes of the length's low byte.
+  std::thread consumer([&] {
+    std::unique_ptr<char[]> data(new char[kMaxLen]);
+    while (!stop) {
+      uint32_t pos = buf.consumePos();
+      uint32_t len;
+      if (!buf.read(pos, reinterpret_cast<char *>(&len), sizeof(len)))
+        continue;
+      if (len == 0 || len > kMaxLen) {
+        torn++;
+        continue;
+      }
+      if (!buf.read(pos + sizeof(len), data.get(), len))
+        continue;
+      if (std::count(data.get(), data.get() + len, static_cast<char>(len)) !=
+          static_cast<ssize_t>(len))
+        torn++;
+      if (buf.release(pos, sizeof(len) + len))
+        consumed++;
+    }
+  });
+
+  std::string record;
+  for (int i = 0; i < kRecordCount || consumed == 0; ++i) {
+    uint32_t len = 1 + (i * 7919u) % kMaxLen;
+    record.assign(sizeof(len) + len, static_cast<char>(len));
+    memcpy(&record[0], &len, sizeof(len));
+    while (buf.unused() < record.size())
+      buf.discard();
+    buf.produce(record.data(), record.size());
+    buf.incConsumablePos(record.size());
+  }
+  stop = true;
+  consumer.join();
+
+  TEST_INT_EQ(torn, 0);
+}
+
 int main() {
   test_blocking_buffer();
+  test_blocking_buffer_reserve();
+  test_blocking_buffer_size();
+  test_blocking_buffer_discard();
 
   PRINT_PASS_RATE();
 
@@ -0,0 +1,231 @@
+//===- CompressTest.cpp - Log Compression Test ------------------*- C++ -*-===//
+//
+/// \file
+/// Block compression, FrameCompressor and FrameDecoder Test routine.
+//
+// Author:  zxh
+// Date:    2022/04/16 10:12:37
+//===----------------------------------------------------------------------===//
+
+#include "Test.h"
+
+#include <limlog.h>
+
+#include <random>
+
+using namespace limlog;
+
+static std::string g_frames;
+static std::string g_output;
+
+ssize_t capture_frames(const char *data, size_t n) {
+  g_frames.append(data, n);
+  return n;
+}
+
+ssize_t capture(const char *data, size_t n) {
+  g_output.append(data, n);
+  return n;
+}
+
+std::string compress(const std::string &s) {
+  std::string r(compressBound(s.size()), '\0');
+  r.resize(compressBlock(s.data(), s.size(), &r[0]));
+  return r;
+}
+
+// Decompressed \a s , or "<corrupted>".
+std::string decompress(const std::string &s, size_t cap) {
+  std::string r(cap, '\0');
+  ssize_t n = decompressBlock(s.data(), s.size(), &r[0], cap);
+  return n < 0 ? "<corrupted>" : r.substr(0, n);
+}
+
+// Log like text of \a n bytes.
+std::string log_text(size_t n, std::mt19937 &rng) {
+  static const char *kLevels[] = {"INFO", "WARN", "ERRO", "DEBU"};
+  static const char *kMsgs[] = {"connect peer=10.0.0.", "timeout after ms=",
+                                "login user=", "read bytes="};
+  std::string s;
+  while (s.size() < n) {
+    s += kLevels[rng() % 4];
+    s += " 2022-04-16 10:12:" + std::to_string(10 + rng() % 50) + ".";
+    s += std::to_string(100000 + rng() % 900000) + " 42 ";
+    s += kMsgs[rng() % 4] + std::to_string(rng() % 1000) + "\n";
+  }
+  s.resize(n);
+  return s;
+}
+
+void test_block() {
+  TEST_STRING_EQ(decompress(compress(""), 0), "");
+  TEST_STRING_EQ(decompress(compress("a"), 1), "a");
+  TEST_STRING_EQ(decompress(compress("hello hello hello"), 17),
+                 "hello hello hello");
+
+  // long literal and match lengths, overlapping matches.
+  std::string s = std::string(300, 'a') + "0123456789abcdef" +
+                  std::string(1000, 'b') + "0123456789abcdef";
+  std::string c = compress(s);
+  TEST_INT_EQ(c.size() < 64, true);
+  TEST_STRING_EQ(decompress(c, s.size()), s);
+
+  // random lengths and contents, compressible or not.
+  std::mt19937 rng(20220416);
+  int mismatch = 0;
+  for (int i = 0; i < 2000; ++i) {
+    size_t n = i < 100 ? i : rng() % kFrameSize;
+    std::string t = log_text(n, rng);
+    if (i % 3 == 0)
+      for (char &ch : t)
+        ch = static_cast<char>(rng());
+    if (decompress(compress(t), n) != t)
+      mismatch++;
+  }
+  TEST_INT_EQ(mismatch, 0);
+
+  // corrupted.
+  TEST_STRING_EQ(decompress(c, s.size() - 1), "<corrupted>");
+  TEST_STRING_EQ(decompress(c.substr(0, c.size() - 1), s.size()),
+                 "<corrupted>");
+  TEST_STRING_EQ(decompress(std::string("\x00\x00\x00", 3), 16),
+                 "<corrupted>"); // offset 0.
+  TEST_STRING_EQ(decompress(std::string("\x10" "a" "\x02\x00", 4), 16),
+                 "<corrupted>"); // offset beyond the output.
+  TEST_STRING_EQ(decompress(std::string("\xf0\xff\xff", 3), 1024),
+                 "<corrupted>"); // incomplete length.
+}
+
+// Frames of \a s by FrameCompressor.
+std::string compress_frames(const std::string &s) {
+  FrameCompressor compressor;
+  compressor.setOutput(capture_frames);
+  g_frames.clear();
+  struct iovec iov = {const_cast<char *>(s.data()), s.size()};
+  compressor.compress(&iov, 1);
+  return g_frames;
+}
+
+// Decode \a frames in chunks of \a chunk bytes.
+std::string decode_frames(const std::string &frames, size_t chunk,
+                          bool *ok = nullptr, size_t *pending = nullptr,
+                          uint64_t *skipped = nullptr) {
+  FrameDecoder decoder;
+  decoder.setOutput(capture);
+  g_output.clear();
+  bool r = true;
+  for (size_t i = 0; i < frames.size(); i += chunk)
+    r &= decoder.decode(frames.data() + i,
+                        std::min(chunk, frames.size() - i)) >= 0;
+  if (ok)
+    *ok = r;
+  if (pending)
+    *pending = decoder.pending();
+  if (skipped)
+    *skipped = decoder.skipped();
+  return g_output;
+}
+
+void test_frame() {
+  std::mt19937 rng(20220416);
+  std::string s = log_text(kFrameSize * 3 + 100, rng);
+
+  FrameCompressor compressor;
+  compressor.setOutput(capture_frames);
+  g_frames.clear();
+  struct iovec iov[] = {{&s[0], 100}, {&s[100], s.size() - 100}};
+  TEST_SIZE_EQ(compressor.compress(iov, 2), s.size());
+  std::string frames = g_frames;
+  TEST_SIZE_EQ(compressor.rawBytes(), s.size());
+  TEST_SIZE_EQ(compressor.bytes(), frames.size());
+  TEST_INT_EQ(frames.size() < s.size() / 3, true);
+
+  bool ok;
+  size_t pending;
+  TEST_STRING_EQ(decode_frames(frames, frames.size()), s);
+  TEST_STRING_EQ(decode_frames(frames, 1, &ok, &pending), s);
+  TEST_INT_EQ(ok, true);
+  TEST_SIZE_EQ(pending, 0);
+
+  // incompressible data is stored.
+  std::string random(1000, '\0');
+  for (char &ch : random)
+    ch = static_cast<char>(rng());
+  std::string stored = compress_frames(random);
+  TEST_SIZE_EQ(stored.size(), sizeof(FrameHeader) + random.size());
+  TEST_STRING_EQ(decode_frames(stored, 7), random);
+}
+
+void test_truncated_frame() {
+  std::mt19937 rng(20220416);
+  std::string first = log_text(1000, rng);
+  std::string second = log_text(2000, rng);
+  std::string fa = compress_frames(first);
+  std::string fb = compress_frames(second);
+  std::string frames = fa + fb;
+
+  // frames before the truncated one are readable.
+  bool ok;
+  size_t pending;
+  TEST_STRING_EQ(decode_frames(frames.substr(0, frames.size() - 1), 64, &ok,
+                               &pending),
+                 first);
+  TEST_INT_EQ(ok, true);
+  TEST_SIZE_EQ(pending, fb.size() - 1);
+  TEST_STRING_EQ(decode_frames(frames.substr(0, fa.size() + 3), 64, &ok,
+                               &pending),
+                 first);
+  TEST_SIZE_EQ(pending, 3);
+
+  // corrupted frames are skipped.
+  uint64_t skipped;
+  std::string corrupted = frames;
+  corrupted[2] ^= 1; // magic.
+  TEST_STRING_EQ(decode_frames(corrupted, 64, &ok, &pending, &skipped),
+                 second);
+  TEST_INT_EQ(ok, false);
+  TEST_SIZE_EQ(skipped, fa.size());
+
+  corrupted = frames;
+  corrupted[5] ^= 1; // raw length.
+  TEST_STRING_EQ(decode_frames(corrupted, 64, &ok, &pending, &skipped),
+                 second);
+  TEST_SIZE_EQ(skipped, fa.size());
+
+  corrupted = std::string("garbage") + frames;
+  corrupted.insert(fa.size() + 7, "xx");
+  TEST_STRING_EQ(decode_frames(corrupted, 5, &ok, &pending, &skipped),
+                 first + second);
+  TEST_INT_EQ(ok, false);
+  TEST_SIZE_EQ(skipped, 9);
+  TEST_SIZE_EQ(pending, 0);
+}
+
+void test_logline_compress() {
+  FrameCompressor::instance().setOutput(capture_frames);
+  singleton()->setOutput(FrameCompressor::writev);
+  singleton()->setPattern("%L %m");
+  g_frames.clear();
+
+  std::string expect;
+  for (int i = 0; i < 1000; ++i) {
+    LOG_INFO << "compressed " << i;
+    expect += "INFO compressed " + std::to_string(i) + "\n";
+  }
+  singleton()->flush();
+
+  TEST_STRING_EQ(decode_frames(g_frames, 100), expect);
+  singleton()->setOutput(StdoutWriter::write);
+  singleton()->setPattern("%L %T %t %f:%l %m");
+}
+
+int main() {
+  test_block();
+  test_frame();
+  test_truncated_frame();
+  test_logline_compress();
+
+  PRINT_PASS_RATE();
+
+  return !ALL_TEST_PASS();
+}
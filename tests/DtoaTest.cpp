@@ -0,0 +1,116 @@
+//===- DtoaTest.cpp - Dtoa Test ---------------------------------*- C++ -*-===//
+//
+/// \file
+/// Test of float number to string.
+//
+// Author:  zxh
+// Date:    2022/03/12 16:05:42
+//===----------------------------------------------------------------------===//
+
+#include "Test.h"
+
+#include <limlog.h>
+
+#include <stdlib.h>
+
+#include <random>
+
+using namespace limlog;
+
+#define TEST_STRING_FLOAT_EQ(actual, expect)                                   \
+  do {                                                                         \
+    char buf[kMaxFloatLen];                                                    \
+    size_t len = formatFloat(actual, buf);                                     \
+    TEST_STRING_EQ(std::string(buf, len), expect);                             \
+  } while (0)
+
+#define TEST_STRING_FIXED_EQ(actual, precision, expect)                        \
+  do {                                                                         \
+    char buf[kMaxFloatLen];                                                    \
+    size_t len = formatFloatFixed(actual, buf, precision);                     \
+    TEST_STRING_EQ(std::string(buf, len), expect);                             \
+  } while (0)
+
+void test_dtoa() {
+  TEST_STRING_FLOAT_EQ(0.0, "0");
+  TEST_STRING_FLOAT_EQ(-0.0, "-0");
+  TEST_STRING_FLOAT_EQ(1.0, "1");
+  TEST_STRING_FLOAT_EQ(-1.0, "-1");
+  TEST_STRING_FLOAT_EQ(1.23, "1.23");
+  TEST_STRING_FLOAT_EQ(3.14159, "3.14159");
+  TEST_STRING_FLOAT_EQ(0.1, "0.1");
+  TEST_STRING_FLOAT_EQ(0.001234, "0.001234");
+  TEST_STRING_FLOAT_EQ(1e-7, "1e-7");
+  TEST_STRING_FLOAT_EQ(1.5e-7, "1.5e-7");
+  TEST_STRING_FLOAT_EQ(123456789012.0, "123456789012");
+  TEST_STRING_FLOAT_EQ(1e21, "1e+21");
+  TEST_STRING_FLOAT_EQ(1.2345e30, "1.2345e+30");
+  TEST_STRING_FLOAT_EQ(1.7976931348623157e308, "1.7976931348623157e+308");
+  TEST_STRING_FLOAT_EQ(-2.2250738585072014e-308, "-2.2250738585072014e-308");
+  TEST_STRING_FLOAT_EQ(5e-324, "5e-324");
+  TEST_STRING_FLOAT_EQ(std::numeric_limits<double>::quiet_NaN(), "nan");
+  TEST_STRING_FLOAT_EQ(std::numeric_limits<double>::infinity(), "inf");
+  TEST_STRING_FLOAT_EQ(-std::numeric_limits<double>::infinity(), "-inf");
+
+  // float is formatted with its own precision.
+  TEST_STRING_FLOAT_EQ(0.1f, "0.1");
+  TEST_STRING_FLOAT_EQ(3.14159f, "3.14159");
+  TEST_STRING_FLOAT_EQ(-1.5f, "-1.5");
+  TEST_STRING_FLOAT_EQ(3.4028235e38f, "3.4028235e+38");
+  TEST_STRING_FLOAT_EQ(1e-45f, "1e-45");
+}
+
+void test_dtoa_round_trip() {
+  std::mt19937_64 rng(20220312);
+  int double_fail = 0;
+  int float_fail = 0;
+
+  for (int i = 0; i < 1000000; ++i) {
+    uint64_t bits = rng();
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    if (!std::isfinite(d))
+      continue;
+
+    char buf[kMaxFloatLen + 1];
+    buf[formatFloat(d, buf)] = '\0';
+    if (strtod(buf, nullptr) != d)
+      double_fail++;
+
+    uint32_t fbits = static_cast<uint32_t>(bits);
+    float f;
+    memcpy(&f, &fbits, sizeof(f));
+    if (!std::isfinite(f))
+      continue;
+
+    buf[formatFloat(f, buf)] = '\0';
+    if (strtof(buf, nullptr) != f)
+      float_fail++;
+  }
+
+  TEST_INT_EQ(double_fail, 0);
+  TEST_INT_EQ(float_fail, 0);
+}
+
+void test_dtoa_fixed() {
+  TEST_STRING_FIXED_EQ(3.14159, 2, "3.14");
+  TEST_STRING_FIXED_EQ(3.14159, 0, "3");
+  TEST_STRING_FIXED_EQ(-3.14159, 4, "-3.1416");
+  TEST_STRING_FIXED_EQ(0.001, 3, "0.001");
+  TEST_STRING_FIXED_EQ(0.0005, 6, "0.000500");
+  TEST_STRING_FIXED_EQ(9.9999, 3, "10.000");
+  TEST_STRING_FIXED_EQ(1.5f, 1, "1.5");
+  TEST_STRING_FIXED_EQ(123456789.0, 9, "123456789.000000000");
+  TEST_STRING_FIXED_EQ(1e20, 2, "100000000000000000000");
+  TEST_STRING_FIXED_EQ(std::numeric_limits<double>::infinity(), 2, "inf");
+}
+
+int main() {
+  test_dtoa();
+  test_dtoa_round_trip();
+  test_dtoa_fixed();
+
+  PRINT_PASS_RATE();
+
+  return !ALL_TEST_PASS();
+}
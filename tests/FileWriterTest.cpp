@@ -0,0 +1,250 @@
+//===- FileWriterTest.cpp - File Writer Test --------------------*- C++ -*-===//
+//
+/// \file
+/// MmapFileWriter, FdWriter and UringFileWriter Test routine.
+//
+// Author:  zxh
+// Date:    2022/03/15 22:48:03
+//===----------------------------------------------------------------------===//
+
+#include "Test.h"
+
+#include <limlog.h>
+
+#include <dirent.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <sstream>
+
+using namespace limlog;
+
+std::vector<std::string> list_dir(const std::string &dir) {
+  std::vector<std::string> files;
+  DIR *d = opendir(dir.c_str());
+  while (struct dirent *e = readdir(d)) {
+    std::string name(e->d_name);
+    if (name != "." && name != "..")
+      files.push_back(dir + "/" + name);
+  }
+  closedir(d);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+std::string read_file(const std::string &path) {
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+void remove_dir(const std::string &dir) {
+  for (auto &f : list_dir(dir))
+    unlink(f.c_str());
+  rmdir(dir.c_str());
+}
+
+void test_mmap_file_writer() {
+  char tmpl[] = "/tmp/limlog_test_XXXXXX";
+  std::string dir = mkdtemp(tmpl);
+  std::string path = dir + "/test.log";
+
+  std::string expect;
+  for (int i = 0; i < 1000; ++i)
+    expect += "INFO mmap file writer line " + std::to_string(i) + "\n";
+
+  {
+    MmapFileWriter w;
+    TEST_INT_EQ(w.open(path, 4096), true);
+
+    const char *p = expect.data();
+    size_t left = expect.size();
+    while (left > 0) {
+      size_t n = std::min<size_t>(left, 100);
+      TEST_SIZE_EQ(w.append(p, n), n);
+      p += n;
+      left -= n;
+    }
+  }
+
+  // rotated files and the current one.
+  std::vector<std::string> files = list_dir(dir);
+  size_t count = (expect.size() + 4095) / 4096;
+  TEST_SIZE_EQ(files.size(), count);
+
+  // archives are named 'test.log.YYYYmmdd-HHMMSS[.seq]', sorted by
+  // sequence except the current 'test.log'.
+  std::string actual;
+  std::sort(files.begin(), files.end(),
+            [](const std::string &a, const std::string &b) {
+              return a.size() != b.size() ? a.size() < b.size() : a < b;
+            });
+  for (size_t i = 1; i < files.size(); ++i) {
+    TEST_SIZE_EQ(read_file(files[i]).size(), 4096);
+    actual += read_file(files[i]);
+  }
+  TEST_INT_EQ(files[0] == path, true);
+  actual += read_file(files[0]);
+  TEST_SIZE_EQ(actual.size(), expect.size());
+  TEST_INT_EQ(actual == expect, true);
+
+  // reopen rotates the existing file.
+  {
+    MmapFileWriter w;
+    TEST_INT_EQ(w.open(path, 4096), true);
+    TEST_SIZE_EQ(w.append("hello\n", 6), 6);
+  }
+  TEST_SIZE_EQ(list_dir(dir).size(), count + 1);
+  TEST_STRING_EQ(read_file(path), "hello\n");
+
+  remove_dir(dir);
+}
+
+// Segments of \a s , in lengths 0, 1, 2 ... cyclically.
+std::vector<struct iovec> split(std::string &s) {
+  std::vector<struct iovec> iov;
+  for (size_t pos = 0, n = 0; pos < s.size(); pos += n, n = (n + 1) % 100) {
+    n = std::min(n, s.size() - pos);
+    iov.push_back({&s[pos], n});
+  }
+  return iov;
+}
+
+// The file is opened again by append() after a failure.
+void test_mmap_file_writer_retry() {
+  char tmpl[] = "/tmp/limlog_test_XXXXXX";
+  std::string dir = mkdtemp(tmpl);
+  std::string path = dir + "/sub/test.log";
+
+  {
+    MmapFileWriter w;
+    TEST_INT_EQ(w.open(path, 4096), false);
+    TEST_INT_EQ(static_cast<int>(w.append("lost\n", 5)), -1);
+
+    mkdir((dir + "/sub").c_str(), 0755);
+    TEST_INT_EQ(static_cast<int>(w.append("lost\n", 5)), -1); // not yet.
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    TEST_SIZE_EQ(w.append("hello\n", 6), 6);
+  }
+  TEST_STRING_EQ(read_file(path), "hello\n");
+
+  remove_dir(dir + "/sub");
+  remove_dir(dir);
+}
+
+void test_fd_writer() {
+  char tmpl[] = "/tmp/limlog_test_XXXXXX";
+  std::string dir = mkdtemp(tmpl);
+  std::string path = dir + "/test.log";
+
+  std::string expect;
+  for (int i = 0; i < 1000; ++i)
+    expect += "INFO fd writer line " + std::to_string(i) + "\n";
+  std::vector<struct iovec> iov = split(expect);
+
+  // more segments than a system call.
+  {
+    FdWriter w;
+    TEST_INT_EQ(w.open(path), true);
+    TEST_SIZE_EQ(w.append(iov.data(), static_cast<int>(iov.size())),
+                 expect.size());
+  }
+  TEST_INT_EQ(read_file(path) == expect, true);
+
+  // reopen appends.
+  FdWriter::instance().open(path);
+  TEST_SIZE_EQ(FdWriter::write("hello\n", 6), 6);
+  FdWriter::instance().close();
+  TEST_INT_EQ(read_file(path) == expect + "hello\n", true);
+  remove_dir(dir);
+
+  // partial writes to a pipe read slowly.
+  int fds[2];
+  TEST_INT_EQ(pipe(fds), 0);
+  fcntl(fds[1], F_SETPIPE_SZ, 4096);
+  std::string actual;
+  std::thread reader([&] {
+    char buf[1000];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+      actual.append(buf, n);
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  });
+  FdWriter::instance().setFd(fds[1]);
+  TEST_SIZE_EQ(FdWriter::writev(iov.data(), static_cast<int>(iov.size())),
+               expect.size());
+  FdWriter::instance().close();
+  close(fds[1]);
+  reader.join();
+  close(fds[0]);
+  TEST_INT_EQ(actual == expect, true);
+}
+
+void test_uring_file_writer(bool uring) {
+  char tmpl[] = "/tmp/limlog_test_XXXXXX";
+  std::string dir = mkdtemp(tmpl);
+  std::string path = dir + "/test.log";
+
+  // more than all buffers, written in lines and in large pieces.
+  std::string expect;
+  for (int i = 0; i < 100000; ++i)
+    expect += "INFO uring file writer line " + std::to_string(i) + "\n";
+  TEST_INT_EQ(expect.size() > UringFileWriter::kBufferSize *
+                                  UringFileWriter::kBufferCount,
+              true);
+
+  {
+    UringFileWriter w;
+    TEST_INT_EQ(w.open(path, uring), true);
+    if (!uring)
+      TEST_INT_EQ(w.uring(), false);
+
+    size_t half = expect.find('\n', expect.size() / 2) + 1;
+    size_t written = 0;
+    for (size_t pos = 0, end; pos < half; pos = end + 1) {
+      end = expect.find('\n', pos);
+      written += w.append(&expect[pos], end + 1 - pos);
+    }
+    TEST_SIZE_EQ(written, half);
+    TEST_SIZE_EQ(w.append(&expect[half], expect.size() - half),
+                 expect.size() - half);
+
+    w.flush();
+    TEST_INT_EQ(read_file(path) == expect, true);
+    TEST_SIZE_EQ(w.errors(), 0);
+  }
+  TEST_INT_EQ(read_file(path) == expect, true);
+
+  // reopen appends, and logs of threads are all written.
+  const int kThreadCount = 4;
+  {
+    UringFileWriter w;
+    TEST_INT_EQ(w.open(path, uring), true);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreadCount; ++i)
+      threads.emplace_back([&w] {
+        for (int j = 0; j < 10000; ++j)
+          w.append("thread log line\n", 16);
+      });
+    for (auto &t : threads)
+      t.join();
+  }
+  TEST_SIZE_EQ(read_file(path).size(), expect.size() + kThreadCount * 160000);
+
+  TEST_SIZE_EQ(UringFileWriter::write("x", 1), -1); // not opened.
+  remove_dir(dir);
+}
+
+int main() {
+  test_mmap_file_writer();
+  test_mmap_file_writer_retry();
+  test_fd_writer();
+  test_uring_file_writer(true);
+  test_uring_file_writer(false);
+
+  PRINT_PASS_RATE();
+
+  return !ALL_TEST_PASS();
+}
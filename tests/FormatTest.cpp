@@ -0,0 +1,244 @@
+//===- FormatTest.cpp - Log Format Test -------------------------*- C++ -*-===//
+//
+/// \file
+/// JSON and logfmt output and string escaping Test routine.
+//
+// Author:  zxh
+// Date:    2022/04/09 11:26:08
+//===----------------------------------------------------------------------===//
+
+#include "Test.h"
+
+#include <limlog.h>
+
+#include <random>
+
+using namespace limlog;
+
+static std::string g_output;
+
+ssize_t capture(const char *data, size_t n) {
+  g_output.append(data, n);
+  return n;
+}
+
+std::string escape(const std::string &s) {
+  std::string r(s.size() * kMaxEscapeLen, '\0');
+  r.resize(escapeString(s.data(), s.size(), &r[0]));
+  return r;
+}
+
+// Escape byte by byte without SSE2.
+std::string escape_scalar(const std::string &s) {
+  std::string r(s.size() * kMaxEscapeLen, '\0');
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(s.data());
+  const uint8_t *end = p + s.size();
+  char *o = &r[0];
+  while (p < end) {
+    if (*p < ' ' || *p >= 0x80 || *p == '"' || *p == '\\')
+      escapeByte(p, end, o);
+    else
+      *o++ = static_cast<char>(*p++);
+  }
+  r.resize(o - &r[0]);
+  return r;
+}
+
+void test_escape() {
+  TEST_STRING_EQ(escape(""), "");
+  TEST_STRING_EQ(escape("plain text"), "plain text");
+  TEST_STRING_EQ(escape("say \"hi\"\\"), "say \\\"hi\\\"\\\\");
+  TEST_STRING_EQ(escape("a\nb\rc\td\be\f"), "a\\nb\\rc\\td\\be\\f");
+  TEST_STRING_EQ(escape(std::string("\x00\x1f\x7f", 3)), "\\u0000\\u001f\x7f");
+
+  // valid UTF-8 is kept, invalid bytes are replaced.
+  TEST_STRING_EQ(escape("\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80"),
+                 "\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80");
+  TEST_STRING_EQ(escape("\xff"), "\\ufffd");
+  TEST_STRING_EQ(escape("\xc3"), "\\ufffd");
+  TEST_STRING_EQ(escape("\xc0\xaf"), "\\ufffd\\ufffd");         // overlong.
+  TEST_STRING_EQ(escape("\xed\xa0\x80"), "\\ufffd\\ufffd\\ufffd"); // surrogate.
+  TEST_STRING_EQ(escape("\xf4\x90\x80\x80"),
+                 "\\ufffd\\ufffd\\ufffd\\ufffd"); // above U+10FFFF.
+
+  // escaped bytes at each position of 16 bytes blocks.
+  for (size_t i = 0; i < 40; ++i) {
+    std::string s(40, 'x');
+    s[i] = '"';
+    std::string escaped = s.substr(0, i) + "\\\"" + s.substr(i + 1);
+    TEST_STRING_EQ(escape(s), escaped);
+  }
+
+  // random bytes, compared with the scalar one.
+  std::mt19937 rng(20220409);
+  const char kBytes[] =
+      "abc \"\\\n\x01\xc3\xa9\xe4\xb8\xad\xf0\x9f\x98\x80\xff";
+  int mismatch = 0;
+  for (int i = 0; i < 10000; ++i) {
+    std::string s(rng() % 100, ' ');
+    for (char &c : s)
+      c = kBytes[rng() % (sizeof(kBytes) - 1)];
+    if (escape(s) != escape_scalar(s))
+      mismatch++;
+  }
+  TEST_INT_EQ(mismatch, 0);
+}
+
+void test_append_escaped() {
+  // escaped in chunks split at the character boundaries.
+  std::string s;
+  for (size_t i = 0; i < kEscapeChunk; ++i)
+    s += "\xe4\xb8\xad";
+
+  g_output.clear();
+  singleton()->setOutput(capture);
+  singleton()->setFormat(kJsonFormat);
+  singleton()->setPattern("%m");
+  LOG_INFO << s;
+  TEST_STRING_EQ(g_output, "{\"msg\":\"" + s + "\"}\n");
+}
+
+// Log with the location, without time and thread id.
+void log_fields() {
+  LOG(kInfo, LogLoc("net/tcp.cc", "connect", 7)).kv("user", 42)
+      << "login \"" << 1 << '"';
+  LOG(kWarn, LogLoc()) << "retry" << kv("n", 3) << kv("ok", false)
+                       << kv("rate", 0.5) << kv("peer", std::string("a b"))
+                       << kv("c", 'x');
+  LOG(kError, LogLoc()) << "";
+  LOG(kError, LogLoc()).kv("nan", std::nan("")).kv("f", fixed(1.25, 1));
+  LOG(kInfo, LogLoc()) << "a" << kv("k", "v") << "b";
+}
+
+void test_format() {
+  singleton()->setOutput(capture);
+  singleton()->setPattern("%L %f:%l %m");
+
+  singleton()->setFormat(kTextFormat);
+  g_output.clear();
+  log_fields();
+  TEST_STRING_EQ(g_output, "INFO net/tcp.cc:7 user=42 login \"1\"\n"
+                           "WARN retry n=3 ok=false rate=0.5 peer=a b c=x\n"
+                           "ERRO \n"
+                           "ERRO nan=nan f=1.3\n"
+                           "INFO a k=v b\n");
+
+  singleton()->setFormat(kJsonFormat);
+  g_output.clear();
+  log_fields();
+  TEST_STRING_EQ(
+      g_output,
+      "{\"level\":\"INFO\",\"file\":\"net/tcp.cc\",\"line\":7,\"user\":42,"
+      "\"msg\":\"login \\\"1\\\"\"}\n"
+      "{\"level\":\"WARN\",\"msg\":\"retry\",\"n\":3,\"ok\":false,"
+      "\"rate\":0.5,\"peer\":\"a b\",\"c\":\"x\"}\n"
+      "{\"level\":\"ERRO\",\"msg\":\"\"}\n"
+      "{\"level\":\"ERRO\",\"nan\":null,\"f\":1.3,\"msg\":\"\"}\n"
+      "{\"level\":\"INFO\",\"msg\":\"a\",\"k\":\"v\",\"msg\":\"b\"}\n");
+
+  singleton()->setFormat(kLogfmtFormat);
+  g_output.clear();
+  log_fields();
+  TEST_STRING_EQ(g_output,
+                 "level=INFO file=\"net/tcp.cc\" line=7 user=42 "
+                 "msg=\"login \\\"1\\\"\"\n"
+                 "level=WARN msg=\"retry\" n=3 ok=false rate=0.5 "
+                 "peer=\"a b\" c=\"x\"\n"
+                 "level=ERRO msg=\"\"\n"
+                 "level=ERRO nan=nan f=1.3 msg=\"\"\n"
+                 "level=INFO msg=\"a\" k=\"v\" msg=\"b\"\n");
+
+  // fields after the message in pattern.
+  singleton()->setFormat(kJsonFormat);
+  singleton()->setPattern("%m %L");
+  g_output.clear();
+  LOG(kInfo, LogLoc()).kv("k", 1) << "m";
+  TEST_STRING_EQ(g_output, "{\"k\":1,\"msg\":\"m\",\"level\":\"INFO\"}\n");
+
+  singleton()->setFormat(kTextFormat);
+  singleton()->setPattern("%L %T %t %f:%l %m");
+}
+
+std::string format_to(const HexInt &v) {
+  char buf[kMaxWidth];
+  return std::string(buf, v.formatTo(buf));
+}
+
+std::string format_to(const WidthInt &v) {
+  char buf[kMaxWidth];
+  return std::string(buf, v.formatTo(buf));
+}
+
+void test_manipulator() {
+  TEST_STRING_EQ(format_to(hex(0)), "0");
+  TEST_STRING_EQ(format_to(hex(255)), "ff");
+  TEST_STRING_EQ(format_to(hex(255, 4)), "00ff");
+  TEST_STRING_EQ(format_to(hex(0x1234, 2)), "1234");
+  TEST_STRING_EQ(format_to(hex(static_cast<int8_t>(-1))), "ff");
+  TEST_STRING_EQ(format_to(hex(-1)), "ffffffff");
+  TEST_STRING_EQ(format_to(hex(UINT64_MAX)), "ffffffffffffffff");
+  TEST_STRING_EQ(format_to(hex(1, 100)), std::string(kMaxWidth - 1, '0') + "1");
+
+  TEST_STRING_EQ(format_to(width(42, 5)), "00042");
+  TEST_STRING_EQ(format_to(width(-42, 5)), "-0042");
+  TEST_STRING_EQ(format_to(width(-42, 5, ' ')), "  -42");
+  TEST_STRING_EQ(format_to(width(123456, 3)), "123456");
+  TEST_STRING_EQ(format_to(width(0, 0)), "0");
+  TEST_STRING_EQ(format_to(width(INT64_MIN, 22, ' ')),
+                 "  -9223372036854775808");
+  TEST_STRING_EQ(format_to(width(7, -1)), "7");
+
+  char buf[kMaxPointerLen];
+  TEST_STRING_EQ(std::string(buf, formatPointer(nullptr, buf)), "0x0");
+  void *p = reinterpret_cast<void *>(0xdeadbeef);
+  TEST_STRING_EQ(std::string(buf, formatPointer(p, buf)), "0xdeadbeef");
+  p = reinterpret_cast<void *>(UINTPTR_MAX);
+  TEST_STRING_EQ(std::string(buf, formatPointer(p, buf)),
+                 "0x" + std::string(sizeof(void *) * 2, 'f'));
+}
+
+void log_manipulators() {
+  const char data[] = "ab\"cd";
+  int *p = reinterpret_cast<int *>(0x1f);
+  LOG(kInfo, LogLoc()) << hex(255, 4) << ' ' << width(-7, 3) << ' ' << p << ' '
+                       << span(data, 3) << kv("h", hex(10))
+                       << kv("w", width(5, 2, ' ')) << kv("p", p)
+                       << kv("s", span(std::string("x y")));
+}
+
+void test_logline_manipulator() {
+  singleton()->setOutput(capture);
+  singleton()->setPattern("%m");
+
+  singleton()->setFormat(kTextFormat);
+  g_output.clear();
+  log_manipulators();
+  TEST_STRING_EQ(g_output, "00ff -07 0x1f ab\" h=a w= 5 p=0x1f s=x y\n");
+
+  singleton()->setFormat(kJsonFormat);
+  g_output.clear();
+  log_manipulators();
+  TEST_STRING_EQ(g_output, "{\"msg\":\"00ff -07 0x1f ab\\\"\",\"h\":\"a\","
+                           "\"w\":\" 5\",\"p\":\"0x1f\",\"s\":\"x y\"}\n");
+
+  singleton()->setFormat(kLogfmtFormat);
+  g_output.clear();
+  log_manipulators();
+  TEST_STRING_EQ(g_output, "msg=\"00ff -07 0x1f ab\\\"\" h=\"a\" w=\" 5\" "
+                           "p=\"0x1f\" s=\"x y\"\n");
+
+  singleton()->setFormat(kTextFormat);
+  singleton()->setPattern("%L %T %t %f:%l %m");
+}
+
+int main() {
+  test_escape();
+  test_append_escaped();
+  test_format();
+  test_manipulator();
+  test_logline_manipulator();
+
+  PRINT_PASS_RATE();
+
+  return !ALL_TEST_PASS();
+}
@@ -12,6 +12,10 @@
 
 #include <limlog.h>
 
+#include <inttypes.h>
+
+#include <random>
+
 using namespace limlog;
 
 #define TEST_STRING_INTEGER_EQ(actual, expect)                                 \
@@ -43,8 +47,110 @@ void test_itoa() {
 #endif
 }
 
+template <typename T> std::string to_string_printf(T v) {
+  char buf[32];
+  if (std::is_signed<T>::value)
+    snprintf(buf, sizeof(buf), "%" PRId64, static_cast<int64_t>(v));
+  else
+    snprintf(buf, sizeof(buf), "%" PRIu64, static_cast<uint64_t>(v));
+  return buf;
+}
+
+// Values around each power of 10 in \a T .
+template <typename T> void test_itoa_widths() {
+  T p = 1;
+  while (true) {
+    TEST_STRING_INTEGER_EQ(static_cast<T>(p - 1), to_string_printf<T>(p - 1));
+    TEST_STRING_INTEGER_EQ(p, to_string_printf(p));
+    TEST_STRING_INTEGER_EQ(static_cast<T>(p + 1), to_string_printf<T>(p + 1));
+    if (std::is_signed<T>::value) {
+      TEST_STRING_INTEGER_EQ(static_cast<T>(-p), to_string_printf<T>(-p));
+      TEST_STRING_INTEGER_EQ(static_cast<T>(-p + 1),
+                             to_string_printf<T>(-p + 1));
+    }
+    if (p > std::numeric_limits<T>::max() / 10)
+      break;
+    p *= 10;
+  }
+
+  T max = std::numeric_limits<T>::max();
+  T min = std::numeric_limits<T>::min();
+  TEST_STRING_INTEGER_EQ(max, to_string_printf(max));
+  TEST_STRING_INTEGER_EQ(min, to_string_printf(min));
+  TEST_STRING_INTEGER_EQ(static_cast<T>(max - 1), to_string_printf<T>(max - 1));
+  TEST_STRING_INTEGER_EQ(static_cast<T>(min + 1), to_string_printf<T>(min + 1));
+}
+
+// Random values of all digits, compared with printf.
+template <typename T> void test_itoa_random() {
+  std::mt19937_64 rng(20220410);
+  int mismatch = 0;
+  for (int i = 0; i < 100000; ++i) {
+    // random bits width, so all digits are covered.
+    T v = static_cast<T>(rng() >> (rng() % 64));
+    char buf[32];
+    if (std::string(buf, formatInt(v, buf)) != to_string_printf(v))
+      mismatch++;
+  }
+  TEST_INT_EQ(mismatch, 0);
+}
+
+// The scalar one used without SSE2.
+void test_itoa_scalar() {
+  std::mt19937_64 rng(20220410);
+  int mismatch = 0;
+  for (int i = 0; i < 100000; ++i) {
+    uint64_t v = rng() >> (rng() % 64);
+    char buf[32];
+    size_t n = countDigits(v);
+    formatDigitsScalar(v, buf, n);
+    if (std::string(buf, n) != to_string_printf(v))
+      mismatch++;
+  }
+  TEST_INT_EQ(mismatch, 0);
+}
+
+void test_count_digits() {
+  TEST_SIZE_EQ(countDigits(0), 1);
+  uint64_t p = 1;
+  for (size_t n = 1; n <= 20; ++n, p *= 10) {
+    TEST_SIZE_EQ(countDigits(p), n);
+    if (n > 1)
+      TEST_SIZE_EQ(countDigits(p - 1), n - 1);
+  }
+  TEST_SIZE_EQ(countDigits(UINT64_MAX), 20);
+}
+
+void test_itoa_width() {
+  char buf[32];
+  TEST_STRING_EQ(std::string(buf, formatUIntWidth(0, buf, 3)), "000");
+  TEST_STRING_EQ(std::string(buf, formatUIntWidth(7, buf, 2)), "07");
+  TEST_STRING_EQ(std::string(buf, formatUIntWidth(2022, buf, 4)), "2022");
+  TEST_STRING_EQ(std::string(buf, formatUIntWidth(123456789, buf, 3)), "123");
+  TEST_STRING_EQ(std::string(buf, formatUIntWidth(123456789, buf, 0)), "");
+  TEST_STRING_EQ(std::string(buf, formatUIntWidth(UINT64_MAX, buf, 20)),
+                 "18446744073709551615");
+  TEST_STRING_EQ(std::string(buf, formatUIntWidth(123456789012ULL, buf, 16)),
+                 "0000123456789012");
+}
+
 int main() {
   test_itoa();
+  test_itoa_widths<int8_t>();
+  test_itoa_widths<uint8_t>();
+  test_itoa_widths<int16_t>();
+  test_itoa_widths<uint16_t>();
+  test_itoa_widths<int32_t>();
+  test_itoa_widths<uint32_t>();
+  test_itoa_widths<int64_t>();
+  test_itoa_widths<uint64_t>();
+  test_itoa_random<int32_t>();
+  test_itoa_random<uint32_t>();
+  test_itoa_random<int64_t>();
+  test_itoa_random<uint64_t>();
+  test_itoa_scalar();
+  test_count_digits();
+  test_itoa_width();
 
   PRINT_PASS_RATE();
 
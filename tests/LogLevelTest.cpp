@@ -0,0 +1,186 @@
+//===- LogLevelTest.cpp - Log Level Test ------------------------*- C++ -*-===//
+//
+/// \file
+/// Compile time and per module log level Test routine.
+//
+// Author:  zxh
+// Date:    2022/04/02 20:41:16
+//===----------------------------------------------------------------------===//
+
+#define LIMLOG_MIN_LEVEL limlog::kDebug
+
+#include "Test.h"
+
+#include <limlog.h>
+
+using namespace limlog;
+
+static std::string g_output;
+static std::mutex g_mutex; // threads log concurrently.
+
+ssize_t capture(const char *data, size_t n) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  g_output.append(data, n);
+  return n;
+}
+
+static int g_evaluated = 0;
+
+int evaluate() { return ++g_evaluated; }
+
+// Count the logs of the loglines output since last call.
+size_t count_logs() {
+  singleton()->flush();
+  std::lock_guard<std::mutex> lock(g_mutex);
+  size_t n = std::count(g_output.begin(), g_output.end(), '\n');
+  g_output.clear();
+  return n;
+}
+
+void test_min_level() {
+  singleton()->setLogLevel(kTrace);
+
+  // eliminated at compile time, neither output nor evaluated.
+  LOG_TRACE << evaluate();
+  TEST_INT_EQ(g_evaluated, 0);
+  TEST_SIZE_EQ(count_logs(), 0);
+
+  LOG_DEBUG << evaluate();
+  TEST_INT_EQ(g_evaluated, 1);
+  TEST_SIZE_EQ(count_logs(), 1);
+  g_evaluated = 0;
+}
+
+void test_runtime_level() {
+  singleton()->setLogLevel(kWarn);
+  for (int i = 0; i < 2; ++i) {
+    LOG_INFO << evaluate();
+    LOG_WARN << evaluate();
+  }
+  TEST_INT_EQ(g_evaluated, 2);
+  TEST_SIZE_EQ(count_logs(), 2);
+
+  // the cached level of the sites is updated.
+  singleton()->setLogLevel(kInfo);
+  for (int i = 0; i < 2; ++i) {
+    LOG_DEBUG << evaluate();
+    LOG_INFO << evaluate();
+  }
+  TEST_INT_EQ(g_evaluated, 4);
+  TEST_SIZE_EQ(count_logs(), 2);
+  g_evaluated = 0;
+}
+
+void log_files() {
+  LOG(kInfo, LogLoc("src/net/tcp.cc", "f", 1)) << "tcp";
+  LOG(kInfo, LogLoc("src/net/udp.cc", "f", 1)) << "udp";
+  LOG(kInfo, LogLoc("src/netlink.cc", "f", 1)) << "netlink";
+  LOG(kInfo, LogLoc("src/db/sql.cc", "f", 1)) << "sql";
+  LOG(kInfo, LogLoc("sql.cc", "f", 1)) << "sql";
+}
+
+void test_module_level() {
+  singleton()->setLogLevel(kInfo);
+  log_files();
+  TEST_SIZE_EQ(count_logs(), 5);
+
+  // module.
+  singleton()->setLogLevel("net/", kWarn);
+  log_files();
+  TEST_SIZE_EQ(count_logs(), 3);
+
+  // longer pattern of file takes effect.
+  singleton()->setLogLevel("net/udp.cc", kInfo);
+  singleton()->setLogLevel("sql.cc", kError);
+  log_files();
+  TEST_SIZE_EQ(count_logs(), 2);
+
+  // module levels are kept on changing the global level.
+  singleton()->setLogLevel(kError);
+  log_files();
+  TEST_SIZE_EQ(count_logs(), 1);
+
+  singleton()->resetLogLevel("net/");
+  singleton()->resetLogLevel("net/udp.cc");
+  singleton()->resetLogLevel("sql.cc");
+  singleton()->setLogLevel(kInfo);
+  log_files();
+  TEST_SIZE_EQ(count_logs(), 5);
+}
+
+// Log at location \a file given at run time in the same statement.
+void log_at(const char *file) { LOG(kInfo, LogLoc(file, "f", 1)) << file; }
+
+void test_runtime_location() {
+  singleton()->setLogLevel(kInfo);
+  singleton()->setLogLevel("net/", kWarn);
+
+  // the level is of the location of each call, not the first one.
+  count_logs();
+  log_at("src/net/tcp.cc");
+  log_at("src/db/sql.cc");
+  log_at("src/net/udp.cc");
+  log_at("src/db/sql.cc");
+  TEST_SIZE_EQ(count_logs(), 2);
+
+  std::string file = "src/db/sql.cc";
+  log_at(file.c_str());
+  TEST_SIZE_EQ(count_logs(), 1);
+  TEST_INT_EQ(RuntimeSites::find(kInfo, LogLoc("src/db/sql.cc", "f", 1)) ==
+                  RuntimeSites::find(kInfo, LogLoc(file.c_str(), "f", 1)),
+              true);
+  TEST_INT_EQ(RuntimeSites::find(kInfo, LogLoc("src/net/tcp.cc", "f", 1)) ==
+                  nullptr,
+              true);
+  singleton()->resetLogLevel("net/");
+
+  // disabled by the global level without looking up the site.
+  TEST_INT_EQ(RuntimeSites::find(kDebug, LogLoc("src/db/sql.cc", "f", 1)) ==
+                  nullptr,
+              true);
+
+  // locations more than the sites are still logged.
+  for (int i = 0; i < 10000; ++i)
+    LOG(kInfo, LogLoc("src/db/sql.cc", "f", i + 1)) << i;
+  TEST_SIZE_EQ(count_logs(), 10000);
+}
+
+// Change log levels while logging in other threads.
+void test_level_concurrently() {
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&stop] {
+      while (!stop)
+        LOG(kInfo, LogLoc("src/net/tcp.cc", "f", 1)) << "tcp";
+    });
+  }
+
+  for (int i = 0; i < 1000; ++i) {
+    singleton()->setLogLevel("net/", i % 2 == 0 ? kWarn : kInfo);
+    singleton()->setLogLevel(i % 2 == 0 ? kInfo : kWarn);
+  }
+  singleton()->setLogLevel("net/", kWarn);
+  stop = true;
+  for (auto &t : threads)
+    t.join();
+
+  count_logs();
+  LOG(kInfo, LogLoc("src/net/tcp.cc", "f", 1)) << "tcp";
+  TEST_SIZE_EQ(count_logs(), 0);
+  singleton()->resetLogLevel("net/");
+}
+
+int main() {
+  singleton()->setOutput(capture);
+
+  test_min_level();
+  test_runtime_level();
+  test_module_level();
+  test_runtime_location();
+  test_level_concurrently();
+
+  PRINT_PASS_RATE();
+
+  return !ALL_TEST_PASS();
+}
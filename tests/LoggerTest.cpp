@@ -0,0 +1,641 @@
+//===- LoggerTest.cpp - Logger Test -----------------------------*- C++ -*-===//
+//
+/// \file
+/// SyncLogger and AsyncLogger Test routine.
+//
+// Author:  zxh
+// Date:    2022/03/06 10:12:45
+//===----------------------------------------------------------------------===//
+
+#include "Test.h"
+
+#include <limlog.h>
+
+using namespace limlog;
+
+static std::string g_output;
+static size_t g_output_count = 0;
+
+ssize_t capture(const char *data, size_t n) {
+  g_output.append(data, n);
+  g_output_count++;
+  return n;
+}
+
+void reset_capture() {
+  g_output.clear();
+  g_output_count = 0;
+}
+
+ssize_t capture_vec(const struct iovec *iov, int cnt) {
+  ssize_t n = 0;
+  for (int i = 0; i < cnt; ++i) {
+    g_output.append(static_cast<const char *>(iov[i].iov_base),
+                    iov[i].iov_len);
+    n += iov[i].iov_len;
+  }
+  g_output_count++;
+  return n;
+}
+
+// Hold the background thread in output until the gate is opened, so the
+// buffer of logging thread gets full.
+static std::atomic<bool> g_gate(false);
+
+ssize_t capture_gated(const char *data, size_t n) {
+  while (!g_gate)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  return capture(data, n);
+}
+
+template <typename Logger> void produce_lines(LimLog<Logger> *log, int count) {
+  for (int i = 0; i < count; ++i) {
+    char line[32];
+    size_t n = formatInt(i, line);
+    line[n++] = '\n';
+    log->produce(line, n);
+    log->flush(n);
+  }
+}
+
+// Produce \a count lines with length \a len , start with the line number.
+template <typename Logger>
+void produce_long_lines(LimLog<Logger> *log, int count, size_t len) {
+  std::string line(len, 'x');
+  line.back() = '\n';
+  for (int i = 0; i < count; ++i) {
+    formatInt(i, &line[0]);
+    log->produce(line.data(), len);
+    log->flush(len);
+  }
+}
+
+// Count lines and check their numbers are increasing.
+int count_increasing_lines(const std::string &s, int *last) {
+  int count = 0;
+  size_t pos = 0;
+  *last = -1;
+  while (pos < s.size()) {
+    size_t end = s.find('\n', pos);
+    if (end == std::string::npos)
+      return -1;
+    int v = std::stoi(s.substr(pos, end - pos));
+    if (v <= *last)
+      return -1;
+    *last = v;
+    count++;
+    pos = end + 1;
+  }
+  return count;
+}
+
+// Check each thread output lines in order, lines of different threads may
+// interleave.
+bool check_lines_in_order(const std::string &s, int count) {
+  std::vector<int> next;
+  size_t pos = 0;
+  while (pos < s.size()) {
+    size_t end = s.find('\n', pos);
+    if (end == std::string::npos)
+      return false;
+    int v = std::stoi(s.substr(pos, end - pos));
+    auto it = std::find(next.begin(), next.end(), v);
+    if (it != next.end())
+      ++*it;
+    else if (v == 0)
+      next.push_back(1);
+    else
+      return false;
+    pos = end + 1;
+  }
+  return std::count(next.begin(), next.end(), count) ==
+         static_cast<ssize_t>(next.size());
+}
+
+void test_sync_logger() {
+  reset_capture();
+  {
+    LimLog<SyncLogger> log;
+    log.setOutput(capture);
+    produce_lines(&log, 1000);
+  }
+
+  TEST_INT_EQ(static_cast<int>(g_output_count), 1000);
+  TEST_INT_EQ(check_lines_in_order(g_output, 1000), true);
+}
+
+void test_sync_logger_batched() {
+  reset_capture();
+  {
+    LimLog<SyncLogger> log;
+    log.setOutput(capture);
+    log.setFlushPolicy(FlushPolicy(0, 100, std::chrono::milliseconds(0)));
+    produce_lines(&log, 1050);
+    TEST_INT_EQ(static_cast<int>(g_output_count), 10);
+
+    log.flush();
+    TEST_INT_EQ(static_cast<int>(g_output_count), 11);
+    TEST_INT_EQ(check_lines_in_order(g_output, 1050), true);
+
+    // lines are '0\n' ~ '9\n', output once 8 bytes batched.
+    reset_capture();
+    log.setFlushPolicy(FlushPolicy(8, 0, std::chrono::milliseconds(0)));
+    produce_lines(&log, 10);
+    TEST_INT_EQ(static_cast<int>(g_output_count), 2);
+    TEST_STRING_EQ(g_output, "0\n1\n2\n3\n4\n5\n6\n7\n");
+
+    // the rest are output when logger destroyed.
+  }
+  TEST_STRING_EQ(g_output, "0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n");
+}
+
+void test_async_logger() {
+  const int kThreadCount = 4;
+  const int kLineCount = 100000;
+
+  reset_capture();
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreadCount; ++i)
+      threads.emplace_back(produce_lines<AsyncLogger>, &log, kLineCount);
+    for (auto &t : threads)
+      t.join();
+  }
+
+  // lines are output in batch.
+  bool batched = g_output_count < kThreadCount * kLineCount;
+  TEST_INT_EQ(batched, true);
+  TEST_INT_EQ(static_cast<int>(std::count(g_output.begin(), g_output.end(),
+                                          '\n')),
+              kThreadCount * kLineCount);
+  TEST_INT_EQ(check_lines_in_order(g_output, kLineCount), true);
+}
+
+void test_sync_logger_overflow() {
+  // a log larger than buffer is output in pieces directly.
+  std::string big(3 * 1024 * 1024, 'x');
+  reset_capture();
+  {
+    LimLog<SyncLogger> log;
+    log.setOutput(capture);
+    log.produce("head", 4);
+    log.produce(big.data(), big.size());
+    log.produce("tail\n", 5);
+    log.flush(4 + big.size() + 5);
+    TEST_SIZE_EQ(g_output.size(), big.size() + 9);
+    TEST_INT_EQ(g_output.compare(0, 4, "head"), 0);
+    TEST_INT_EQ(g_output.compare(g_output.size() - 5, 5, "tail\n"), 0);
+
+    // or dropped.
+    reset_capture();
+    log.setOverflowPolicy(kDropNewest);
+    log.produce("head", 4);
+    log.produce(big.data(), big.size());
+    log.produce("tail\n", 5);
+    log.flush(4 + big.size() + 5);
+    produce_lines(&log, 1);
+    TEST_STRING_EQ(g_output, "0\n");
+    TEST_INT_EQ(static_cast<int>(log.logger()->dropped()), 1);
+  }
+}
+
+static const int kLongLineCount = 8000;
+static const size_t kLongLineLen = 1000; // 8 MB, more than buffer and batch.
+
+void test_async_logger_block() {
+  const int kLineCount = kLongLineCount;
+  const size_t kLineLen = kLongLineLen;
+  int count, last;
+
+  // wait until the background thread catches up.
+  reset_capture();
+  g_gate = false;
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture_gated);
+    std::thread opener([] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      g_gate = true;
+    });
+    produce_long_lines(&log, kLineCount, kLineLen);
+    opener.join();
+    TEST_INT_EQ(static_cast<int>(log.logger()->dropped()), 0);
+  }
+  count = count_increasing_lines(g_output, &last);
+  TEST_INT_EQ(count, kLineCount);
+}
+
+void test_async_logger_drop_newest() {
+  const int kLineCount = kLongLineCount;
+  const size_t kLineLen = kLongLineLen;
+  int count, last;
+
+  // drop the lines not fit.
+  reset_capture();
+  g_gate = false;
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture_gated);
+    log.setOverflowPolicy(kDropNewest);
+    produce_long_lines(&log, kLineCount, kLineLen);
+    g_gate = true;
+
+    count = static_cast<int>(kLineCount - log.logger()->dropped());
+    TEST_INT_EQ(count < kLineCount, true);
+  }
+  TEST_INT_EQ(count_increasing_lines(g_output, &last), count);
+}
+
+void test_async_logger_overwrite_oldest() {
+  const int kLineCount = kLongLineCount;
+  const size_t kLineLen = kLongLineLen;
+  int count, last;
+
+  // discard the lines not consumed, the newest lines are kept.
+  reset_capture();
+  g_gate = false;
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture_gated);
+    log.setOverflowPolicy(kOverwriteOldest);
+    produce_long_lines(&log, kLineCount, kLineLen);
+    g_gate = true;
+
+    TEST_INT_EQ(log.logger()->discarded() > 0, true);
+    TEST_INT_EQ(static_cast<int>(log.logger()->dropped()), 0);
+  }
+  count = count_increasing_lines(g_output, &last);
+  TEST_INT_EQ(count > 0 && count < kLineCount, true);
+  TEST_INT_EQ(last, kLineCount - 1);
+}
+
+void test_sync_logger_buffer_size() {
+  reset_capture();
+  {
+    LimLog<SyncLogger> log;
+    log.setOutput(capture);
+    log.setBufferSize(4096, 65536);
+    TEST_INT_EQ(static_cast<int>(log.logger()->bufferSize()), 4096);
+
+    // grow for the large log, and it is output in one piece.
+    produce_long_lines(&log, 1, 10000);
+    TEST_INT_EQ(static_cast<int>(log.logger()->bufferSize()), 16384);
+    TEST_INT_EQ(static_cast<int>(g_output_count), 1);
+
+    // shrink once idle.
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    produce_lines(&log, 1);
+    TEST_INT_EQ(static_cast<int>(log.logger()->bufferSize()), 4096);
+  }
+  TEST_SIZE_EQ(g_output.size(), 10002);
+}
+
+void test_async_logger_buffer_size() {
+  const int kLineCount = 500;
+  int last;
+
+  reset_capture();
+  g_gate = false;
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture_gated);
+    log.setOverflowPolicy(kDropNewest);
+    log.setBufferSize(65536, 1024 * 1024);
+
+    // grow instead of dropping lines.
+    produce_long_lines(&log, kLineCount, kLongLineLen);
+    TEST_INT_EQ(static_cast<int>(log.logger()->dropped()), 0);
+    TEST_INT_EQ(static_cast<int>(log.logger()->bufferSize()), 512 * 1024);
+    g_gate = true;
+
+    // shrink once idle.
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    produce_long_lines(&log, 1024, 16);
+    TEST_INT_EQ(static_cast<int>(log.logger()->bufferSize()), 65536);
+  }
+  size_t grown = kLineCount * kLongLineLen;
+  TEST_INT_EQ(count_increasing_lines(g_output.substr(0, grown), &last),
+              kLineCount);
+  TEST_INT_EQ(count_increasing_lines(g_output.substr(grown), &last), 1024);
+}
+
+void test_logger_retire() {
+  const int kThreadCount = 100;
+  const int kLineCount = 100;
+
+  reset_capture();
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture);
+
+    // the logger of exited thread is reused by the next thread.
+    std::vector<AsyncLogger *> loggers;
+    for (int i = 0; i < kThreadCount; ++i)
+      std::thread([&] {
+        produce_lines(&log, kLineCount);
+        loggers.push_back(log.logger());
+      }).join();
+    TEST_INT_EQ(static_cast<int>(std::count(loggers.begin(), loggers.end(),
+                                            loggers[0])),
+                kThreadCount);
+  }
+  TEST_INT_EQ(check_lines_in_order(g_output, kLineCount), true);
+  TEST_INT_EQ(static_cast<int>(std::count(g_output.begin(), g_output.end(),
+                                          '\n')),
+              kThreadCount * kLineCount);
+
+  // the batched logs are output when the thread exits.
+  reset_capture();
+  {
+    LimLog<SyncLogger> log;
+    log.setOutput(capture);
+    log.setFlushPolicy(FlushPolicy(0, 100, std::chrono::milliseconds(0)));
+    std::thread(produce_lines<SyncLogger>, &log, 10).join();
+    TEST_STRING_EQ(g_output, "0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n");
+  }
+}
+
+void test_logger_register_concurrently() {
+  const int kThreadCount = 32;
+  const int kLineCount = 1000;
+
+  reset_capture();
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture);
+
+    // threads register while the background thread iterates loggers.
+    std::mutex mutex;
+    std::vector<AsyncLogger *> loggers;
+    for (int round = 0; round < 2; ++round) {
+      std::vector<std::thread> threads;
+      for (int i = 0; i < kThreadCount; ++i)
+        threads.emplace_back([&] {
+          produce_lines(&log, kLineCount);
+          std::lock_guard<std::mutex> lock(mutex);
+          loggers.push_back(log.logger());
+        });
+      for (auto &t : threads)
+        t.join();
+    }
+
+    // loggers of the first round are reused by the second.
+    std::sort(loggers.begin(), loggers.end());
+    ssize_t distinct = std::unique(loggers.begin(), loggers.end()) -
+                       loggers.begin();
+    TEST_INT_EQ(distinct <= kThreadCount, true);
+  }
+  TEST_INT_EQ(static_cast<int>(std::count(g_output.begin(), g_output.end(),
+                                          '\n')),
+              2 * kThreadCount * kLineCount);
+  TEST_INT_EQ(check_lines_in_order(g_output, kLineCount), true);
+}
+
+// Produce \a count lines of current time, the time of log is the same.
+void produce_time_lines(LimLog<AsyncLogger> *log, int count) {
+  for (int i = 0; i < count; ++i) {
+    char line[32];
+    int64_t now = Time::now().count();
+    size_t n = formatInt(now, line);
+    line[n++] = '\n';
+    log->logger()->begin(now);
+    log->produce(line, n);
+    log->flush(n);
+  }
+}
+
+void test_async_logger_merge() {
+  const int kThreadCount = 4;
+  const int kLineCount = 10000;
+
+  reset_capture();
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture);
+    log.setReorderWindow(std::chrono::milliseconds(100));
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreadCount; ++i)
+      threads.emplace_back(produce_time_lines, &log, kLineCount);
+    for (auto &t : threads)
+      t.join();
+  }
+
+  // lines of all threads are output in time order.
+  std::vector<int64_t> times;
+  size_t pos = 0;
+  while (pos < g_output.size()) {
+    size_t end = g_output.find('\n', pos);
+    times.push_back(std::stoll(g_output.substr(pos, end - pos)));
+    pos = end + 1;
+  }
+  TEST_INT_EQ(static_cast<int>(times.size()), kThreadCount * kLineCount);
+  TEST_INT_EQ(std::is_sorted(times.begin(), times.end()), true);
+
+  // flush outputs the logs within the window.
+  reset_capture();
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture);
+    log.setReorderWindow(std::chrono::seconds(10));
+    produce_lines(&log, 1);
+    log.flush();
+    for (int i = 0; i < 1000 && g_output.empty(); ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    TEST_STRING_EQ(g_output, "0\n");
+  }
+}
+
+void test_async_logger_idle() {
+  reset_capture();
+  LimLog<AsyncLogger> log;
+  log.setOutput(capture);
+
+  // the idle background thread is woken up by each complete log, no wakeup
+  // is lost while it is going to sleep.
+  int lost = 0;
+  for (size_t i = 1; i <= 1000; ++i) {
+    std::this_thread::sleep_for(std::chrono::microseconds(i % 50));
+    produce_lines(&log, 1);
+    for (int j = 0; j < 100000 && g_output.size() < 2 * i; ++j)
+      std::this_thread::sleep_for(std::chrono::microseconds(10));
+    if (g_output.size() < 2 * i)
+      lost++;
+  }
+  TEST_INT_EQ(lost, 0);
+  TEST_SIZE_EQ(g_output.size(), 2000);
+}
+
+void test_sync_logger_stats() {
+  reset_capture();
+  LimLog<SyncLogger> log;
+  log.setOutput(capture);
+  log.setOutputTiming(true);
+  produce_lines(&log, 1000);
+
+  std::vector<LogStats> loggers;
+  LogStats s = log.stats(&loggers);
+  TEST_INT_EQ(static_cast<int>(s.lines), 1000);
+  TEST_SIZE_EQ(s.bytes, g_output.size());
+  TEST_INT_EQ(static_cast<int>(s.outputs), 1000);
+  TEST_SIZE_EQ(s.outputBytes, g_output.size());
+  TEST_INT_EQ(s.highWater >= 2 && s.highWater <= 4, true); // '0\n'~'999\n'
+  TEST_INT_EQ(s.maxOutputNs > 0 && s.maxOutputNs <= s.outputNs, true);
+  TEST_INT_EQ(static_cast<int>(s.dropped + s.blocked), 0);
+  TEST_SIZE_EQ(loggers.size(), 1);
+  TEST_INT_EQ(loggers[0].tid == limlog::gettid(), true);
+
+  // retired loggers are counted, and the reused one keeps counting.
+  const int kThreadCount = 4;
+  for (int i = 0; i < kThreadCount; ++i)
+    std::thread(produce_lines<SyncLogger>, &log, 100).join();
+  loggers.clear();
+  s = log.stats(&loggers);
+  TEST_INT_EQ(static_cast<int>(s.lines), 1000 + kThreadCount * 100);
+  TEST_SIZE_EQ(loggers.size(), 2);
+  TEST_INT_EQ(static_cast<int>(loggers[0].tid), 0);
+  TEST_INT_EQ(static_cast<int>(loggers[0].lines), kThreadCount * 100);
+}
+
+void test_async_logger_stats() {
+  const int kLineCount = kLongLineCount;
+  const size_t kLineLen = kLongLineLen;
+
+  // blocked until the background thread catches up.
+  reset_capture();
+  g_gate = false;
+  LimLog<AsyncLogger> log;
+  log.setOutput(capture_gated);
+  log.setOutputTiming(true);
+  std::thread opener([] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    g_gate = true;
+  });
+  produce_long_lines(&log, kLineCount, kLineLen);
+  opener.join();
+
+  LogStats s = log.stats();
+  while (s.outputBytes != kLineCount * kLineLen) {
+    log.flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    s = log.stats();
+  }
+  TEST_INT_EQ(static_cast<int>(s.lines), kLineCount);
+  TEST_SIZE_EQ(s.bytes, kLineCount * kLineLen);
+  TEST_INT_EQ(s.blocked > 0 && s.blockedNs > 0, true);
+  TEST_INT_EQ(s.highWater > BlockingBuffer::kDefaultSize / 2, true);
+  TEST_INT_EQ(s.outputs > 0 && s.outputs < kLineCount, true); // batched.
+  TEST_INT_EQ(s.maxOutputNs >= 10 * 1000 * 1000, true);       // gated.
+}
+
+void test_vectored_output() {
+  std::string big(3 * 1024 * 1024, 'x');
+  big.back() = '\n';
+
+  // the incomplete log and the one larger than buffer are output in a call.
+  reset_capture();
+  {
+    LimLog<SyncLogger> log;
+    log.setOutput(capture_vec);
+    log.produce("head", 4);
+    log.produce(big.data(), big.size());
+    log.flush(4 + big.size());
+    TEST_INT_EQ(static_cast<int>(g_output_count), 1);
+    TEST_SIZE_EQ(g_output.size(), big.size() + 4);
+
+    produce_lines(&log, 2);
+    TEST_INT_EQ(static_cast<int>(g_output_count), 3);
+
+    // back to OutputFunc.
+    log.setOutput(capture);
+    reset_capture();
+    log.produce("head", 4);
+    log.produce(big.data(), big.size());
+    log.flush(4 + big.size());
+    TEST_INT_EQ(static_cast<int>(g_output_count), 2);
+  }
+
+  // logs larger than batch of background thread are output with the batch,
+  // they are held in the reorder window until flush.
+  const size_t kLargeLen = 5 * 1024 * 1024;
+  std::string large(kLargeLen, 'x');
+  large.back() = '\n';
+  std::string lines = "0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n";
+  reset_capture();
+  {
+    LimLog<AsyncLogger> log;
+    log.setReorderWindow(std::chrono::hours(1));
+    log.setBufferSize(16 * 1024 * 1024);
+    log.setOutput(capture_vec);
+    for (int i = 0; i < 2; ++i) {
+      produce_lines(&log, 10);
+      log.produce(large.data(), large.size());
+      log.flush(large.size());
+    }
+    produce_lines(&log, 10);
+    log.flush();
+    while (log.stats().outputBytes != 2 * kLargeLen + 3 * lines.size())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  TEST_INT_EQ(static_cast<int>(g_output_count), 1);
+  TEST_INT_EQ(g_output == lines + large + lines + large + lines, true);
+}
+
+// Begin a log with \a text , the inner logs are written while writing it.
+void produce_nested(LimLog<AsyncLogger> *log, const std::string &text,
+                    int depth) {
+  log->logger()->begin(Time::now().count());
+  log->produce(text.data(), text.size());
+  if (depth > 0)
+    produce_nested(log, "inner" + std::to_string(depth), depth - 1);
+  log->produce("\n", 1);
+  log->flush(text.size() + 1);
+}
+
+void test_async_logger_nested() {
+  reset_capture();
+  {
+    LimLog<AsyncLogger> log;
+    log.setOutput(capture);
+    produce_lines(&log, 2);
+    produce_nested(&log, "outer", 2);
+    produce_lines(&log, 2);
+    log.flush();
+    while (log.stats().outputBytes != 28)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    TEST_INT_EQ(static_cast<int>(log.stats().lines), 7);
+  }
+  // the innermost log completes first.
+  TEST_STRING_EQ(g_output, "0\n1\nouter\ninner1\ninner2\n0\n1\n");
+}
+
+// Run each test in a new thread, the logger of thread is retired when it
+// exits.
+void run_in_thread(void (*test)()) { std::thread(test).join(); }
+
+int main() {
+  run_in_thread(test_sync_logger);
+  run_in_thread(test_sync_logger_batched);
+  run_in_thread(test_async_logger);
+  run_in_thread(test_sync_logger_overflow);
+  run_in_thread(test_async_logger_block);
+  run_in_thread(test_async_logger_drop_newest);
+  run_in_thread(test_async_logger_overwrite_oldest);
+  run_in_thread(test_sync_logger_buffer_size);
+  run_in_thread(test_async_logger_buffer_size);
+  run_in_thread(test_logger_retire);
+  run_in_thread(test_logger_register_concurrently);
+  run_in_thread(test_async_logger_merge);
+  run_in_thread(test_async_logger_idle);
+  run_in_thread(test_sync_logger_stats);
+  run_in_thread(test_async_logger_stats);
+  run_in_thread(test_vectored_output);
+  run_in_thread(test_async_logger_nested);
+
+  PRINT_PASS_RATE();
+
+  return !ALL_TEST_PASS();
+}
@@ -0,0 +1,91 @@
+//===- PatternTest.cpp - Log Pattern Test -----------------------*- C++ -*-===//
+//
+/// \file
+/// LogPattern Test routine.
+//
+// Author:  zxh
+// Date:    2022/04/05 16:03:52
+//===----------------------------------------------------------------------===//
+
+#include "Test.h"
+
+#include <limlog.h>
+
+using namespace limlog;
+
+static std::string g_output;
+
+ssize_t capture(const char *data, size_t n) {
+  g_output.append(data, n);
+  return n;
+}
+
+struct Out {
+  void append(const char *data, size_t n) { s.append(data, n); }
+
+  template <size_t N, typename Format> void appendFormat(Format format) {
+    char buf[N];
+    s.append(buf, format(buf));
+  }
+
+  std::string s;
+};
+
+// Output of a log "msg" with \a pattern and location \a loc , the time and
+// thread id are fixed.
+std::string format(const std::string &pattern, const LogLoc &loc) {
+  LogPattern p(pattern);
+  Time t{Time::TimePoint(std::chrono::nanoseconds(123456789))};
+  Out out;
+  p.format(out, true, kTextFormat, kWarn, t, 42, loc);
+  out.s += "msg";
+  p.format(out, false, kTextFormat, kWarn, t, 42, loc);
+  return out.s;
+}
+
+void test_pattern() {
+  LogLoc loc("net/tcp.cc", "connect", 7);
+  LogLoc noLoc;
+  Time time{Time::TimePoint(std::chrono::nanoseconds(123456789))};
+  std::string t = time.formatMilli();
+
+  TEST_STRING_EQ(format("%L %T %t %f:%l %m", loc),
+                 "WARN " + t + " 42 net/tcp.cc:7 msg");
+  TEST_STRING_EQ(format("%L %T %t %f:%l %m", noLoc), "WARN " + t + " 42 msg");
+  TEST_STRING_EQ(format("%T{s}|%T{us}|%T{ns}", loc),
+                 time.format() + "|" + time.formatMacro() + "|" +
+                     time.formatNano() + "msg");
+  TEST_STRING_EQ(format("[%t] %F@%f:%l - %m;", loc),
+                 "[42] connect@net/tcp.cc:7 - msg;");
+  TEST_STRING_EQ(format("[%t] %F@%f:%l - %m;", noLoc), "[42] msg;");
+  TEST_STRING_EQ(format("%m %L", loc), "msg WARN");
+  TEST_STRING_EQ(format("100%% %x %T{xs} %", loc),
+                 "100% %x " + t + "{xs} %msg");
+  TEST_STRING_EQ(format("", loc), "msg");
+
+  // literal text longer than 64 KiB.
+  std::string text(70000, 'x');
+  TEST_STRING_EQ(format(text + "%L" + text + "%m", loc),
+                 text + "WARN" + text + "msg");
+}
+
+void test_logline_pattern() {
+  singleton()->setOutput(capture);
+  singleton()->setPattern("%L|%l|%m|%F");
+  int line = __LINE__ + 1;
+  LOG_INFO << "hello";
+  singleton()->setPattern("%m");
+  LOG_INFO << "world";
+
+  TEST_STRING_EQ(g_output, "INFO|" + std::to_string(line) +
+                               "|hello|test_logline_pattern\nworld\n");
+}
+
+int main() {
+  test_pattern();
+  test_logline_pattern();
+
+  PRINT_PASS_RATE();
+
+  return !ALL_TEST_PASS();
+}
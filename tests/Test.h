@@ -27,8 +27,13 @@ static int test_pass = 0;
     }                                                                          \
   } while (0)
 
-#define TEST_INT_EQ(actual, expect) EQ(actual == expect, actual, expect, "%d")
-#define TEST_CHAR_EQ(actual, expect) EQ(actual == expect, actual, expect, "%c")
+#define TEST_INT_EQ(actual, expect)                                            \
+  EQ((actual) == (expect), actual, expect, "%d")
+#define TEST_SIZE_EQ(actual, expect)                                           \
+  EQ(static_cast<size_t>(actual) == static_cast<size_t>(expect),              \
+     static_cast<size_t>(actual), static_cast<size_t>(expect), "%zu")
+#define TEST_CHAR_EQ(actual, expect)                                           \
+  EQ((actual) == (expect), actual, expect, "%c")
 
 #define TEST_STRING_EQ(actual, expect)                                         \
   do {                                                                         \
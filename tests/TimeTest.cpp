@@ -0,0 +1,121 @@
+//===- TimeTest.cpp - Time Test ---------------------------------*- C++ -*-===//
+//
+/// \file
+/// Test of Time format.
+//
+// Author:  zxh
+// Date:    2022/03/08 21:37:16
+//===----------------------------------------------------------------------===//
+
+#include "Test.h"
+
+#include <limlog.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+using namespace limlog;
+
+// 2021-10-10T13:46:58Z
+const time_t kTestSecond = 1633873618;
+
+Time make_time(time_t second, int64_t nano) {
+  return Time(Time::TimePoint(std::chrono::seconds(second)) +
+              std::chrono::nanoseconds(nano));
+}
+
+void set_timezone(const char *tz) {
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+void test_format_utc() {
+  set_timezone("UTC0");
+
+  TEST_STRING_EQ(make_time(kTestSecond, 0).format(), "2021-10-10T13:46:58Z");
+  TEST_STRING_EQ(make_time(kTestSecond, 123456789).format(),
+                 "2021-10-10T13:46:58Z");
+  TEST_STRING_EQ(make_time(kTestSecond, 123456789).formatMilli(),
+                 "2021-10-10T13:46:58.123Z");
+  TEST_STRING_EQ(make_time(kTestSecond, 123456789).formatMacro(),
+                 "2021-10-10T13:46:58.123456Z");
+  TEST_STRING_EQ(make_time(kTestSecond, 123456789).formatNano(),
+                 "2021-10-10T13:46:58.123456789Z");
+
+  // fraction with leading zero.
+  TEST_STRING_EQ(make_time(kTestSecond, 1234567).formatMilli(),
+                 "2021-10-10T13:46:58.001Z");
+  TEST_STRING_EQ(make_time(kTestSecond, 1234567).formatNano(),
+                 "2021-10-10T13:46:58.001234567Z");
+
+  // next second after the cached one.
+  TEST_STRING_EQ(make_time(kTestSecond + 1, 5000000).formatMilli(),
+                 "2021-10-10T13:46:59.005Z");
+  TEST_STRING_EQ(make_time(kTestSecond + 86400, 0).format(),
+                 "2021-10-11T13:46:58Z");
+}
+
+void test_format_offset() {
+  set_timezone("CST-8");
+  TEST_STRING_EQ(make_time(kTestSecond + 1, 0).format(),
+                 "2021-10-10T21:46:59+08:00");
+
+  set_timezone("IST-5:30");
+  TEST_STRING_EQ(make_time(kTestSecond + 2, 0).format(),
+                 "2021-10-10T19:17:00+05:30");
+
+  set_timezone("EST5");
+  TEST_STRING_EQ(make_time(kTestSecond + 3, 100000000).formatMilli(),
+                 "2021-10-10T08:47:01.100-05:00");
+}
+
+void test_format_to() {
+  set_timezone("UTC0");
+
+  char buf[Time::kMaxFormatLen];
+  Time t = make_time(kTestSecond, 999999999);
+  size_t len = t.formatTo(buf, SecFracLen::Nano);
+  TEST_STRING_EQ(std::string(buf, len), "2021-10-10T13:46:58.999999999Z");
+  TEST_STRING_EQ(std::string(buf, len), t.formatNano());
+
+  // same second formatted from cache.
+  len = make_time(kTestSecond, 10000).formatTo(buf, SecFracLen::Macro);
+  TEST_STRING_EQ(std::string(buf, len), "2021-10-10T13:46:58.000010Z");
+}
+
+// Check time of clock source \a source is close to system clock.
+void test_clock_source(ClockSource source, int64_t tolerance) {
+  Time::setClockSource(source);
+  int64_t maxDiff = 0;
+  for (int i = 0; i < 1000; ++i) {
+    int64_t t = Time::now().count();
+    int64_t s = Time(std::chrono::system_clock::now()).count();
+    maxDiff = std::max(maxDiff, std::abs(s - t));
+    std::this_thread::sleep_for(std::chrono::microseconds(i * 2));
+  }
+  TEST_INT_EQ(maxDiff < tolerance, true);
+
+  // time goes backward at most the tolerance when the anchor is reset.
+  int64_t prev = Time::now().count();
+  int64_t maxBackward = 0;
+  for (int i = 0; i < 100000; ++i) {
+    int64_t t = Time::now().count();
+    maxBackward = std::max(maxBackward, prev - t);
+    prev = t;
+  }
+  TEST_INT_EQ(maxBackward < tolerance, true);
+  Time::setClockSource(kSystemClock);
+}
+
+int main() {
+  test_format_utc();
+  test_format_offset();
+  test_format_to();
+  test_clock_source(kSystemClock, 1000 * 1000);
+  test_clock_source(kCoarseClock, 20 * 1000 * 1000);
+  test_clock_source(kTscClock, 1000 * 1000);
+
+  PRINT_PASS_RATE();
+
+  return !ALL_TEST_PASS();
+}
@@ -0,0 +1,80 @@
+//===- LogDecoder.cpp - Binary Log Decoder ----------------------*- C++ -*-===//
+//
+/// \file
+/// Decode binary logs written with LIMLOG_BINARY to text.
+///
+/// Usage: LogDecoder [-p PATTERN] [-f text|json|logfmt] [FILE]...
+/// Decode each FILE in order, or standard input if no FILE, to standard
+/// output. The text is formatted in PATTERN and the output format, see
+/// limlog::LogPattern and limlog::LogFormat.
+//
+// Author:  zxh
+// Date:    2022/03/19 20:15:52
+//===----------------------------------------------------------------------===//
+
+#include <limlog.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// Decode \a in to stdout, return false if data is corrupted.
+bool decode(limlog::BinaryDecoder &decoder, FILE *in) {
+  char buf[64 * 1024];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    if (decoder.decode(buf, n) < 0)
+      return false;
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  limlog::BinaryDecoder decoder;
+  decoder.setOutput(limlog::StdoutWriter::write);
+
+  int first = 1;
+  for (; first + 1 < argc && argv[first][0] == '-'; first += 2) {
+    const char *opt = argv[first];
+    const char *arg = argv[first + 1];
+    if (strcmp(opt, "-p") == 0) {
+      decoder.setPattern(arg);
+    } else if (strcmp(opt, "-f") == 0 && strcmp(arg, "text") == 0) {
+      decoder.setFormat(limlog::kTextFormat);
+    } else if (strcmp(opt, "-f") == 0 && strcmp(arg, "json") == 0) {
+      decoder.setFormat(limlog::kJsonFormat);
+    } else if (strcmp(opt, "-f") == 0 && strcmp(arg, "logfmt") == 0) {
+      decoder.setFormat(limlog::kLogfmtFormat);
+    } else {
+      fprintf(stderr, "LogDecoder: invalid option '%s %s'\n", opt, arg);
+      return 1;
+    }
+  }
+
+  bool ok = true;
+  if (first == argc)
+    ok = decode(decoder, stdin);
+
+  // site records of the former files are used by the latter ones, so rotated
+  // files should be decoded together in order.
+  for (int i = first; i < argc && ok; ++i) {
+    FILE *in = fopen(argv[i], "rb");
+    if (!in) {
+      fprintf(stderr, "LogDecoder: cannot open '%s'\n", argv[i]);
+      return 1;
+    }
+    ok = decode(decoder, in);
+    fclose(in);
+  }
+
+  if (!ok) {
+    fprintf(stderr, "LogDecoder: corrupted data\n");
+    return 1;
+  }
+
+  if (decoder.pending() != 0) {
+    fprintf(stderr, "LogDecoder: truncated record of %zu bytes\n",
+            decoder.pending());
+    return 1;
+  }
+
+  return 0;
+}
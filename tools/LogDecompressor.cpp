@@ -0,0 +1,53 @@
+//===- LogDecompressor.cpp - Compressed Log Decoder -------------*- C++ -*-===//
+//
+/// \file
+/// Decompress logs written with limlog::FrameCompressor.
+///
+/// Usage: LogDecompressor [FILE]...
+/// Decompress each FILE in order, or standard input if no FILE, to standard
+/// output. Frames before a truncated one are output, and corrupted ones are
+/// skipped. Pipe the output to LogDecoder if the logs are binary.
+//
+// Author:  zxh
+// Date:    2022/04/16 15:40:21
+//===----------------------------------------------------------------------===//
+
+#include <limlog.h>
+
+#include <stdio.h>
+
+// Decompress \a in to stdout.
+void decompress(limlog::FrameDecoder &decoder, FILE *in) {
+  char buf[64 * 1024];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    decoder.decode(buf, n);
+}
+
+int main(int argc, char *argv[]) {
+  limlog::FrameDecoder decoder;
+  decoder.setOutput(limlog::StdoutWriter::write);
+
+  if (argc == 1)
+    decompress(decoder, stdin);
+
+  // a frame may be split by file rotation, so rotated files should be
+  // decompressed together in order.
+  for (int i = 1; i < argc; ++i) {
+    FILE *in = fopen(argv[i], "rb");
+    if (!in) {
+      fprintf(stderr, "LogDecompressor: cannot open '%s'\n", argv[i]);
+      return 1;
+    }
+    decompress(decoder, in);
+    fclose(in);
+  }
+
+  if (decoder.skipped() != 0)
+    fprintf(stderr, "LogDecompressor: skipped %llu corrupted bytes\n",
+            static_cast<unsigned long long>(decoder.skipped()));
+  if (decoder.pending() != 0)
+    fprintf(stderr, "LogDecompressor: truncated frame of %zu bytes\n",
+            decoder.pending());
+  return decoder.skipped() == 0 && decoder.pending() == 0 ? 0 : 1;
+}